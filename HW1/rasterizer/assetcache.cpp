@@ -0,0 +1,45 @@
+#include "assetcache.hpp"
+
+#include <exception>
+
+std::shared_ptr<const MeshData> AssetCache::GetMesh(const std::string& modelName, bool useMeshCache, const LodConfig& lod)
+{
+    std::string key = modelName;
+    if (lod.enabled)
+        key += "#lod" + std::to_string(lod.levels) + "x" + std::to_string(lod.ratio);
+
+    std::promise<std::shared_ptr<const MeshData>> promise;
+    MeshFuture future;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto it = this->meshes.find(key);
+        if (it != this->meshes.end())
+            future = it->second;
+        else
+            this->meshes.emplace(key, promise.get_future().share());
+    }
+
+    if (future.valid())
+        return future.get();
+
+    // This caller owns the parse; failures are cached too so a broken model is reported once per batch. An
+    //   exception is handed to the waiters as well, rather than leaving them a broken promise
+    std::shared_ptr<const MeshData> mesh;
+    try
+    {
+        mesh = Loader::LoadMesh(modelName, useMeshCache, lod);
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    promise.set_value(mesh);
+    return mesh;
+}
+
+size_t AssetCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->meshes.size();
+}
@@ -0,0 +1,37 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "loader.hpp"
+
+// Thread-safe cache of parsed meshes, keyed by model name (the `obj` entry of a config) and LOD settings
+
+class AssetCache
+{
+public:
+    AssetCache() = default;
+    AssetCache(const AssetCache&) = delete;
+    AssetCache& operator= (const AssetCache&) = delete;
+
+    // Return the mesh for `modelName`, parsing it on first use. Concurrent callers asking for a model
+    //   that is still being parsed wait for that single parse. Returns nullptr if the model fails to load;
+    //   an exception thrown by the parse reaches every caller. Models loaded with different LOD settings are
+    //   cached separately
+    std::shared_ptr<const MeshData> GetMesh(const std::string& modelName, bool useMeshCache = true,
+        const LodConfig& lod = LodConfig());
+
+    size_t Size() const;
+
+private:
+    using MeshFuture = std::shared_future<std::shared_ptr<const MeshData>>;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, MeshFuture> meshes;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "renderer.hpp"
+
+BatchRenderer::BatchRenderer(uint32_t jobs) : jobs(jobs)
+{
+    if (this->jobs == 0)
+        this->jobs = std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<std::string> BatchRenderer::CollectConfigs(const std::string& source)
+{
+    std::vector<std::string> configs;
+    if (std::filesystem::is_directory(source))
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(source))
+            if (entry.is_regular_file() && entry.path().extension() == ".yaml")
+                configs.push_back(entry.path().string());
+        std::sort(configs.begin(), configs.end());
+    }
+    else
+    {
+        std::ifstream ifs(source);
+        if (!ifs)
+            throw std::runtime_error("cannot open batch list " + source);
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#')
+                configs.push_back(line);
+        }
+    }
+    return configs;
+}
+
+size_t BatchRenderer::Run(const std::vector<std::string>& configs)
+{
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> failed = 0;
+
+    auto worker = [&]()
+    {
+        for (size_t index = next++; index < configs.size(); index = next++)
+        {
+            const std::string& config = configs[index];
+            std::string outputName = std::filesystem::path(config).stem().string();
+            try
+            {
+                Renderer renderer(config);
+                if (!renderer.RenderConfig(config, &this->cache, outputName))
+                    ++failed;
+            }
+            catch (std::exception& e)
+            {
+                std::cerr << "Rendering " << config << " failed..." << std::endl;
+                std::cerr << e.what() << std::endl;
+                ++failed;
+            }
+        }
+    };
+
+    uint32_t threadCount = static_cast<uint32_t>(std::min<size_t>(this->jobs, configs.size()));
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::cout << "Batch finished: " << configs.size() - failed << "/" << configs.size() << " configs rendered, "
+        << this->cache.Size() << " models loaded\n";
+    return failed;
+}
@@ -0,0 +1,31 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "assetcache.hpp"
+
+// Renders many configs in one process; meshes are parsed once and shared between jobs
+
+class BatchRenderer
+{
+public:
+    // `jobs` is the number of configs rendered concurrently; 0 uses every hardware thread
+    BatchRenderer(uint32_t jobs = 0);
+
+    // Collect the configs to render from either a directory (every `.yaml` in it, sorted by name)
+    //   or a text file listing one config path per line
+    static std::vector<std::string> CollectConfigs(const std::string& source);
+
+    // Render every config. Each output is named after its config file, so that configs sharing the
+    //   same `output` entry do not overwrite each other. Returns the number of failed jobs
+    size_t Run(const std::vector<std::string>& configs);
+
+private:
+    uint32_t jobs;
+    AssetCache cache;
+};
+
+#endif
@@ -0,0 +1,237 @@
+// Microbenchmarks for the rasterizer kernels.
+//   Build with -DRASTERIZER_BUILD_BENCHMARKS=ON (and -DRASTERIZER_PRINT_TRIG_DETAIL=OFF), then run
+//     ./bench/RasterizerBench --benchmark_format=json --benchmark_out=bench.json
+//   to get results that can be compared across commits with Google Benchmark's compare.py.
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "entities.hpp"
+#include "image.hpp"
+#include "loader.hpp"
+#include "rasterizer.hpp"
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    const fs::path& BenchDirectory()
+    {
+        static const fs::path dir = []()
+        {
+            fs::path path = fs::temp_directory_path() / "rasterizer-bench";
+            fs::create_directories(path);
+
+            std::ofstream obj(path / "trig.obj");
+            obj << "v -1 -1 0\nv 1 -1 0\nv 0 1 0\nvn 0 0 1\nf 1//1 2//1 3//1\n";
+            return path;
+        }();
+        return dir;
+    }
+
+    // Load a shading config at the given resolution; the loader owns the state the rasterizer reads
+    std::unique_ptr<Loader> MakeLoader(uint32_t resolution)
+    {
+        fs::path config = BenchDirectory() / ("shading-" + std::to_string(resolution) + ".yaml");
+        std::ofstream ofs(config);
+        ofs << "task: shading\n"
+            << "resolution: { width: " << resolution << ", height: " << resolution << " }\n"
+            << "obj: " << (BenchDirectory() / "trig").string() << "\n"
+            << "output: " << (BenchDirectory() / "output").string() << "\n"
+            << "meshCache: false\n"
+            << "camera: { pos: [0.0, 0.0, 2.0], lookAt: [0.0, 0.0, 0.0], up: [0.0, 1.0, 0.0],"
+            << " width: 2.0, height: 2.0, nearClip: 0.1, farClip: 100.0 }\n"
+            << "transforms: [ { rotation: [1.0, 0.0, 0.0, 0.0], translation: [0.0, 0.0, 0.0], scale: [1.0, 1.0, 1.0] } ]\n"
+            << "exponent: 4.0\n"
+            << "ambient: [10, 10, 10]\n"
+            << "lights: [ { pos: [0.0, 1.0, 2.0], intensity: 2.0, color: [255, 255, 255] } ]\n";
+        ofs.close();
+
+        auto loader = std::make_unique<Loader>(config.string());
+        if (!loader->Load())
+            return nullptr;
+        return loader;
+    }
+
+    // A screen-space triangle with legs of `size` pixels, centered in a `resolution` square viewport.
+    //   `original` is the matching world-space triangle facing the camera
+    void MakeTriangle(uint32_t size, uint32_t resolution, Triangle& transformed, Triangle& original)
+    {
+        float lo = 0.5f * static_cast<float>(resolution - size);
+        float hi = lo + static_cast<float>(size);
+        transformed.pos = { glm::vec4(lo, lo, 0.5f, 1.f), glm::vec4(hi, lo, 0.5f, 1.f), glm::vec4(lo, hi, 0.5f, 1.f) };
+
+        float extent = static_cast<float>(size) / static_cast<float>(resolution);
+        original.pos = { glm::vec4(-extent, -extent, 0.f, 1.f), glm::vec4(extent, -extent, 0.f, 1.f),
+            glm::vec4(-extent, extent, 0.f, 1.f) };
+        original.normal = { glm::vec4(0.f, 0.f, 1.f, 0.f), glm::vec4(0.f, 0.f, 1.f, 0.f), glm::vec4(0.f, 0.f, 1.f, 0.f) };
+    }
+
+    // Prepare the matrices exactly as the renderer does before drawing
+    void SetupRasterizer(Rasterizer& rasterizer, const Loader& loader)
+    {
+        for (const MeshTransform& transform : loader.GetTransforms())
+            rasterizer.AddModel(transform);
+        rasterizer.SetView();
+        rasterizer.SetProjection();
+        rasterizer.SetScreenSpace();
+    }
+
+    void SetPixelCounters(benchmark::State& state, uint64_t pixelsPerIteration)
+    {
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * pixelsPerIteration));
+        state.counters["pixels"] = static_cast<double>(pixelsPerIteration);
+    }
+}
+
+static void BM_BarycentricCoordinate(benchmark::State& state)
+{
+    const uint32_t resolution = 512;
+    auto loader = MakeLoader(resolution);
+    if (!loader)
+    {
+        state.SkipWithError("failed to load benchmark config");
+        return;
+    }
+    Rasterizer rasterizer(*loader);
+
+    Triangle transformed, original;
+    MakeTriangle(static_cast<uint32_t>(state.range(0)), resolution, transformed, original);
+    for (auto& v : transformed.pos)
+        v.z = 0.f;
+
+    glm::vec2 pos = (glm::vec2(transformed.pos[0]) + glm::vec2(transformed.pos[1]) + glm::vec2(transformed.pos[2])) / 3.f;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(pos);
+        glm::vec3 bary = rasterizer.BarycentricCoordinate(pos, transformed);
+        benchmark::DoNotOptimize(bary);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BarycentricCoordinate)->Arg(16)->Arg(256);
+
+// Args: triangle size in pixels, resolution
+static void BM_DrawPrimitiveDepth(benchmark::State& state)
+{
+    const uint32_t size = static_cast<uint32_t>(state.range(0));
+    const uint32_t resolution = static_cast<uint32_t>(state.range(1));
+    auto loader = MakeLoader(resolution);
+    if (!loader)
+    {
+        state.SkipWithError("failed to load benchmark config");
+        return;
+    }
+    Rasterizer rasterizer(*loader);
+    SetupRasterizer(rasterizer, *loader);
+
+    Triangle transformed, original;
+    MakeTriangle(size, resolution, transformed, original);
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        rasterizer.InitZBuffer(rasterizer.ZBuffer);
+        state.ResumeTiming();
+
+        rasterizer.DrawPrimitiveDepth(transformed, original, rasterizer.ZBuffer);
+        benchmark::ClobberMemory();
+    }
+    SetPixelCounters(state, uint64_t(size + 1) * (size + 1));
+}
+BENCHMARK(BM_DrawPrimitiveDepth)->ArgsProduct({ { 8, 64, 256 }, { 512, 1024 } });
+
+// Args: triangle size in pixels, resolution
+static void BM_DrawPrimitiveShaded(benchmark::State& state)
+{
+    const uint32_t size = static_cast<uint32_t>(state.range(0));
+    const uint32_t resolution = static_cast<uint32_t>(state.range(1));
+    auto loader = MakeLoader(resolution);
+    if (!loader)
+    {
+        state.SkipWithError("failed to load benchmark config");
+        return;
+    }
+    Rasterizer rasterizer(*loader);
+    SetupRasterizer(rasterizer, *loader);
+    Image image(resolution, resolution, loader->GetOutputName());
+
+    Triangle transformed, original;
+    MakeTriangle(size, resolution, transformed, original);
+    rasterizer.InitZBuffer(rasterizer.ZBuffer);
+    rasterizer.DrawPrimitiveDepth(transformed, original, rasterizer.ZBuffer);
+
+    for (auto _ : state)
+    {
+        rasterizer.DrawPrimitiveShaded(transformed, original, image);
+        benchmark::ClobberMemory();
+    }
+    SetPixelCounters(state, uint64_t(size + 1) * (size + 1));
+}
+BENCHMARK(BM_DrawPrimitiveShaded)->ArgsProduct({ { 8, 64, 256 }, { 512, 1024 } });
+
+// Args: samples per pixel; every pixel in the bounding box of a 64 pixel triangle
+static void BM_DrawPixelSSAA(benchmark::State& state)
+{
+    const uint32_t spp = static_cast<uint32_t>(state.range(0));
+    const uint32_t size = 64, resolution = 512;
+    auto loader = MakeLoader(resolution);
+    if (!loader)
+    {
+        state.SkipWithError("failed to load benchmark config");
+        return;
+    }
+    Rasterizer rasterizer(*loader);
+    Image image(resolution, resolution, loader->GetOutputName());
+
+    Triangle transformed, original;
+    MakeTriangle(size, resolution, transformed, original);
+    for (auto& v : transformed.pos)
+        v.z = 0.f;
+    uint32_t lo = static_cast<uint32_t>(transformed.pos[0].x), hi = lo + size;
+    TriangleSetup setup;
+    TriangleWalk walk;
+    rasterizer.SetupTriangle(transformed, original, setup, walk);
+
+    for (auto _ : state)
+    {
+        for (uint32_t x = lo; x <= hi; ++x)
+            for (uint32_t y = lo; y <= hi; ++y)
+                rasterizer.DrawPixel(x, y, transformed, setup, AntiAliasConfig::SSAA, spp, image, Color::White);
+        benchmark::ClobberMemory();
+    }
+    SetPixelCounters(state, uint64_t(size + 1) * (size + 1));
+    state.counters["spp"] = static_cast<double>(spp);
+}
+BENCHMARK(BM_DrawPixelSSAA)->Arg(1)->Arg(4)->Arg(16)->Arg(64);
+
+// Args: resolution; PNG encoding of a color image
+static void BM_ImageWrite(benchmark::State& state)
+{
+    const uint32_t resolution = static_cast<uint32_t>(state.range(0));
+    Image image(resolution, resolution, (BenchDirectory() / "write").string());
+    for (uint32_t y = 0; y != resolution; ++y)
+        for (uint32_t x = 0; x != resolution; ++x)
+            image.Set(x, y, Color(static_cast<float>(x % 256), static_cast<float>(y % 256), 128.f, 255.f));
+
+    // Write() reports every file on stdout, which would interleave with the console reporter
+    std::ostringstream sink;
+    std::streambuf* previous = std::cout.rdbuf(sink.rdbuf());
+    for (auto _ : state)
+    {
+        image.Write();
+        sink.str("");
+    }
+    std::cout.rdbuf(previous);
+    SetPixelCounters(state, uint64_t(resolution) * resolution);
+}
+BENCHMARK(BM_ImageWrite)->Arg(256)->Arg(512)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,79 @@
+#include "depthbuffer.hpp"
+
+#include "image.hpp"
+
+#include <algorithm>
+
+DepthBuffer::DepthBuffer(uint32_t width, uint32_t height, std::string filename) :
+    // capped as in ImageBuffer, so that the depth covers the same pixels as the image
+    width(std::min(width, 2000u)),
+    height(std::min(height, 2000u)),
+    filename(filename),
+    texels(static_cast<size_t>(this->width) * this->height, 0)
+{
+}
+
+void DepthBuffer::SetFormat(DepthFormat format, float lo, float hi, float clear)
+{
+    this->format = format;
+    this->lo = lo;
+    this->scale = hi > lo ? (MAX_CODE - 1) / (static_cast<double>(hi) - lo) : 1.;
+    this->clear = clear;
+}
+
+void DepthBuffer::Fill(float depth)
+{
+    uint32_t texel = this->format == DepthFormat::UNORM24 ? this->Encode(depth) << 8 : Bits(depth);
+    std::fill(this->texels.begin(), this->texels.end(), texel);
+}
+
+void DepthBuffer::Fill(float depth, uint32_t xmin, uint32_t ymin, uint32_t xmax, uint32_t ymax)
+{
+    if (this->width == 0 || this->height == 0)
+        return;
+    xmax = std::min(xmax, this->width - 1);
+    ymax = std::min(ymax, this->height - 1);
+    if (xmin > xmax)
+        return;
+    uint32_t texel = this->format == DepthFormat::UNORM24 ? this->Encode(depth) << 8 : Bits(depth);
+    for (uint32_t y = ymin; y <= ymax; ++y)
+    {
+        auto row = this->texels.begin() + static_cast<size_t>(y) * this->width;
+        std::fill(row + xmin, row + xmax + 1, texel);
+    }
+}
+
+void DepthBuffer::Write()
+{
+    ImageGrey grey(this->width, this->height, this->filename);
+    for (uint32_t y = 0; y != this->height; ++y)
+        for (uint32_t x = 0; x != this->width; ++x)
+            grey.Set(x, y, this->Get(x, y).value());
+    grey.Write();
+}
+
+float DepthAt(const glm::mat4& screen, const Camera& camera, float distance)
+{
+    glm::vec3 forward = glm::normalize(camera.lookAt - camera.pos);
+    glm::vec4 p = screen * glm::vec4(camera.pos + distance * forward, 1.f);
+    return p.z / p.w;
+}
+
+glm::mat4 ReverseDepth(const glm::mat4& screen, const Camera& camera)
+{
+    glm::vec3 forward = glm::normalize(camera.lookAt - camera.pos);
+    glm::vec4 nearPoint = screen * glm::vec4(camera.pos + camera.nearClip * forward, 1.f);
+    glm::vec4 farPoint = screen * glm::vec4(camera.pos + camera.farClip * forward, 1.f);
+    // w grows with the distance only under a perspective projection
+    if (!(nearPoint.w > 0.f && farPoint.w > nearPoint.w))
+        return screen;
+
+    float nearDepth = nearPoint.z / nearPoint.w, farDepth = farPoint.z / farPoint.w;
+    float sign = nearDepth < farDepth ? -1.f : 1.f;
+
+    // the depth row becomes constant, so the depth after the divide is sign * w(near) / w
+    glm::mat4 reversed = screen;
+    for (int column = 0; column != 4; ++column)
+        reversed[column][2] = column == 3 ? sign * nearPoint.w : 0.f;
+    return reversed;
+}
@@ -0,0 +1,134 @@
+#ifndef DEPTHBUFFER_H
+#define DEPTHBUFFER_H
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "entities.hpp"
+
+#include "../thirdparty/glm/glm.hpp"
+
+// Storage of the ZBuffer. Every format takes 4 bytes per pixel behind the float Set/Get of `ImageGrey`, so the
+//   per-pixel functions read and write depth the same way whichever one is selected
+
+enum class DepthFormat
+{
+    FLOAT,          // the depth as written
+    REVERSED,       // float, with the projected depth replaced by near / distance (see ReverseDepth)
+    UNORM24         // 24-bit fixed point over the depth range of the clip planes, and an 8-bit stencil
+};
+
+class DepthBuffer
+{
+public:
+    static constexpr uint32_t DEPTH_BITS = 24;
+    static constexpr uint32_t MAX_CODE = (1u << DEPTH_BITS) - 1;
+
+    DepthBuffer(uint32_t width, uint32_t height, std::string filename = "output");
+
+    // Select the format of the following writes; the contents are not converted. UNORM24 maps depths from `lo` to
+    //   `hi` onto codes 1 to MAX_CODE, clamping outside of them, and keeps code 0 for `clear`, the value the buffer
+    //   is filled with, so that it reads back exactly
+    void SetFormat(DepthFormat format, float lo, float hi, float clear);
+
+    // Writes outside of the buffer are ignored and reads give no value, as with `ImageGrey`
+    inline void Set(uint32_t x, uint32_t y, float depth)
+    {
+        if (x >= this->width || y >= this->height)
+            return;
+        uint32_t& texel = this->texels[static_cast<size_t>(y) * this->width + x];
+        texel = this->format == DepthFormat::UNORM24 ? (this->Encode(depth) << 8) | (texel & 0xFF) : Bits(depth);
+    }
+    inline std::optional<float> Get(uint32_t x, uint32_t y) const
+    {
+        if (x >= this->width || y >= this->height)
+            return std::nullopt;
+        uint32_t texel = this->texels[static_cast<size_t>(y) * this->width + x];
+        return this->format == DepthFormat::UNORM24 ? this->Decode(texel >> 8) : Value(texel);
+    }
+
+    // Only UNORM24 has stencil bits; with the float formats writes are ignored and reads give 0
+    inline void SetStencil(uint32_t x, uint32_t y, uint8_t stencil)
+    {
+        if (this->format == DepthFormat::UNORM24 && x < this->width && y < this->height)
+        {
+            uint32_t& texel = this->texels[static_cast<size_t>(y) * this->width + x];
+            texel = (texel & ~0xFFu) | stencil;
+        }
+    }
+    inline uint8_t GetStencil(uint32_t x, uint32_t y) const
+    {
+        if (this->format != DepthFormat::UNORM24 || x >= this->width || y >= this->height)
+            return 0;
+        return static_cast<uint8_t>(this->texels[static_cast<size_t>(y) * this->width + x] & 0xFF);
+    }
+
+    // Set every pixel to `depth`, and the stencil to 0
+    void Fill(float depth);
+    // The same for the pixels from (xmin, ymin) to (xmax, ymax), both included and clipped to the buffer
+    void Fill(float depth, uint32_t xmin, uint32_t ymin, uint32_t xmax, uint32_t ymax);
+
+    // Write the depth to a .png file, mapped to grey as `ImageGrey` does
+    void Write();
+
+    inline void SetFilename(std::string filename) { this->filename = filename; }
+    inline const std::string& GetFilename() const { return this->filename; }
+    inline DepthFormat GetFormat() const { return this->format; }
+
+    inline uint32_t GetWidth() const { return this->width; }
+    inline uint32_t GetHeight() const { return this->height; }
+
+private:
+    static inline uint32_t Bits(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    static inline float Value(uint32_t bits)
+    {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t Encode(float depth) const
+    {
+        if (depth == this->clear)
+            return 0;
+        double t = (static_cast<double>(depth) - this->lo) * this->scale;
+        if (!(t > 0.))
+            return 1;
+        if (t >= MAX_CODE - 1)
+            return MAX_CODE;
+        return 1 + static_cast<uint32_t>(t + 0.5);
+    }
+    inline float Decode(uint32_t code) const
+    {
+        if (code == 0)
+            return this->clear;
+        return static_cast<float>(this->lo + (code - 1) / this->scale);
+    }
+
+    uint32_t width, height;
+    std::string filename;
+    DepthFormat format = DepthFormat::FLOAT;
+    double lo = 0., scale = 1.;             // UNORM24 code of a depth is 1 + (depth - lo) * scale
+    float clear = 0.f;
+    std::vector<uint32_t> texels;           // float bits, or the UNORM24 code above 8 stencil bits
+};
+
+// The depth `screen = screenspace * projection * view` gives to the point `distance` along the view direction
+float DepthAt(const glm::mat4& screen, const Camera& camera, float distance);
+
+// Replace the depth row of `screen = screenspace * projection * view`, so that a point gets the depth
+//   near / distance, up to sign: 1 on the near plane and approaching 0 far away, where floats are densest.
+//   Unlike the usual depth, which crowds distant surfaces next to the far value, this keeps them apart.
+//   The sign follows the original projection, so that the depth test still prefers the same side. Returns
+//   `screen` unchanged if it is not a perspective projection
+glm::mat4 ReverseDepth(const glm::mat4& screen, const Camera& camera);
+
+#endif
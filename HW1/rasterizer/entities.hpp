@@ -5,8 +5,10 @@
 
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <optional>
 #include <sstream>
 
 #include "image.hpp"
@@ -18,6 +20,8 @@ struct Triangle
 {
     std::array<glm::vec4, 3> pos;
     std::array<glm::vec4, 3> normal;
+    std::array<glm::vec2, 3> uv;
+    int32_t materialId = -1;        // index into Loader::GetMaterials(), -1 if the face has no material
 
     inline void Homogenize()
     {
@@ -118,6 +122,47 @@ public:
         rotation(rotation), translation(translation), scale(scale) {  }
 };
 
+struct Keyframe
+{
+public:
+    uint32_t frame;
+    std::optional<Camera> camera;               // only pos/lookAt/up are interpolated
+    std::vector<MeshTransform> transforms;      // empty if the keyframe does not move any mesh
+
+    Keyframe(uint32_t frame) : frame(frame), camera(), transforms() {  }
+};
+
+// Axis-aligned bounding box; an empty box has min > max
+struct Bounds
+{
+public:
+    glm::vec3 min;
+    glm::vec3 max;
+
+    Bounds() : min(INFINITY), max(-INFINITY) {  }
+
+    inline void Extend(glm::vec3 p) { this->min = glm::min(this->min, p); this->max = glm::max(this->max, p); }
+    inline bool Empty() const { return this->min.x > this->max.x; }
+    inline glm::vec3 Corner(size_t index) const
+    {
+        return glm::vec3((index & 1) ? this->max.x : this->min.x, (index & 2) ? this->max.y : this->min.y,
+            (index & 4) ? this->max.z : this->min.z);
+    }
+};
+
+struct Material
+{
+public:
+    std::string name;
+    glm::vec3 diffuse;
+    float dissolve;             // 1 == opaque, 0 == fully transparent
+    std::string diffuseTexname; // map_Kd, relative to the model's search path
+    int32_t diffuseTexture;     // index into Loader::GetTextures(), -1 if untextured
+
+    Material(std::string name, glm::vec3 diffuse, float dissolve, std::string diffuseTexname) :
+        name(name), diffuse(diffuse), dissolve(dissolve), diffuseTexname(diffuseTexname), diffuseTexture(-1) {  }
+};
+
 struct Light
 {
 public:
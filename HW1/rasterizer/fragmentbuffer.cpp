@@ -0,0 +1,58 @@
+#include "fragmentbuffer.hpp"
+
+#include <algorithm>
+
+FragmentBuffer::FragmentBuffer(uint32_t width, uint32_t height) :
+    scratch(width, height, "fragments"),
+    width(scratch.GetWidth()),
+    height(scratch.GetHeight()),
+    heads(static_cast<size_t>(width) * height, NONE)
+{
+    // room for two layers over the whole frame before the pool has to grow
+    this->pool.reserve(2 * this->heads.size());
+}
+
+void FragmentBuffer::Reset()
+{
+    std::fill(this->heads.begin(), this->heads.end(), NONE);
+    this->pool.clear();
+}
+
+void FragmentBuffer::Insert(uint32_t x, uint32_t y, float depth, Color color, float alpha)
+{
+    if (x >= this->width || y >= this->height)
+        return;
+
+    uint32_t& head = this->heads[static_cast<size_t>(y) * this->width + x];
+    this->pool.push_back({ depth, color, alpha, head });
+    head = static_cast<uint32_t>(this->pool.size() - 1);
+}
+
+void FragmentBuffer::Resolve(Image& image, bool largerIsCloser)
+{
+    std::vector<const Fragment*> fragments;
+    for (uint32_t y = 0; y != this->height; ++y)
+        for (uint32_t x = 0; x != this->width; ++x)
+        {
+            uint32_t index = this->heads[static_cast<size_t>(y) * this->width + x];
+            if (index == NONE)
+                continue;
+
+            fragments.clear();
+            for (; index != NONE; index = this->pool[index].next)
+                fragments.push_back(&this->pool[index]);
+            std::sort(fragments.begin(), fragments.end(), [largerIsCloser](const Fragment* a, const Fragment* b)
+            {
+                return largerIsCloser ? a->depth < b->depth : a->depth > b->depth;
+            });
+
+            std::optional<Color> background = image.Get(x, y);
+            if (!background.has_value())
+                continue;
+            glm::vec3 color(background->r, background->g, background->b);
+            for (const Fragment* fragment : fragments)
+                color = glm::mix(color, glm::vec3(fragment->color.r, fragment->color.g, fragment->color.b), fragment->alpha);
+            color = glm::clamp(color + 0.5f, 0.f, 255.f);
+            image.Set(x, y, Color(color.x, color.y, color.z, static_cast<float>(background->a)));
+        }
+}
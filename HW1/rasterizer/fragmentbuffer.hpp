@@ -0,0 +1,48 @@
+#ifndef FRAGMENTBUFFER_H
+#define FRAGMENTBUFFER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "image.hpp"
+
+// A-buffer for order-independent transparency: every pixel keeps a linked list of the translucent fragments
+//   in front of the opaque surface, and the lists are composited back to front once the frame is drawn.
+//   Fragments live in a pool that is cleared, but not freed, at the start of every frame, so after the
+//   first frame of an animation no allocation happens while drawing
+
+class FragmentBuffer
+{
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Fragment
+    {
+        float depth;
+        Color color;
+        float alpha;
+        uint32_t next;                  // index of the next fragment of the pixel in the pool, NONE at the end
+    };
+
+    FragmentBuffer(uint32_t width, uint32_t height);
+
+    // Empty every list; the pool keeps its capacity
+    void Reset();
+
+    void Insert(uint32_t x, uint32_t y, float depth, Color color, float alpha);
+
+    // Blend the fragments of every pixel over `image`, farthest first. `largerIsCloser` gives the direction of depth
+    void Resolve(Image& image, bool largerIsCloser);
+
+    inline size_t GetFragmentCount() const { return this->pool.size(); }
+
+    // Target for shading one fragment at a time, the size of the frame
+    Image scratch;
+
+private:
+    uint32_t width, height;
+    std::vector<uint32_t> heads;        // first fragment of every pixel
+    std::vector<Fragment> pool;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#include "frustum.hpp"
+
+Frustum::Frustum(const glm::mat4& clip)
+{
+    // glm is column-major; row i of the matrix is (clip[0][i], clip[1][i], clip[2][i], clip[3][i])
+    glm::vec4 row[4];
+    for (int i = 0; i != 4; ++i)
+        row[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+
+    this->planes = {
+        row[3] + row[0], row[3] - row[0],       // left, right
+        row[3] + row[1], row[3] - row[1],       // bottom, top
+        row[3] + row[2], row[3] - row[2]        // near, far (or far, near)
+    };
+}
+
+Visibility Frustum::Classify(const Bounds& bounds) const
+{
+    if (bounds.Empty())
+        return Visibility::OUTSIDE;
+
+    glm::vec3 center = 0.5f * (bounds.min + bounds.max);
+    glm::vec3 extent = 0.5f * (bounds.max - bounds.min);
+
+    Visibility result = Visibility::INSIDE;
+    for (const glm::vec4& plane : this->planes)
+    {
+        glm::vec3 n(plane);
+        float distance = glm::dot(n, center) + plane.w;
+        float radius = glm::dot(glm::abs(n), extent);
+        if (distance + radius < 0.f)
+            return Visibility::OUTSIDE;
+        if (distance - radius < 0.f)
+            result = Visibility::INTERSECTING;
+    }
+    return result;
+}
@@ -0,0 +1,34 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <array>
+
+#include "entities.hpp"
+
+#include "../thirdparty/glm/glm.hpp"
+
+// View frustum in object space, extracted from a model-view-projection matrix. It relies on the projection of
+//   Rasterizer::SetProjection mapping visible points to w > 0 and |x|, |y|, |z| <= w (OpenGL clip space); under any
+//   other convention it culls visible geometry, which is why `culling` is off unless a config turns it on
+
+enum class Visibility
+{
+    OUTSIDE, INTERSECTING, INSIDE
+};
+
+class Frustum
+{
+public:
+    // Extract the planes of the clip volume -w <= x, y, z <= w from `clip = projection * view * model`.
+    //   The z planes are symmetric, so they hold whichever of the [-1, 1] conventions the projection uses
+    //   for depth; a projection into [0, 1] is still culled conservatively
+    Frustum(const glm::mat4& clip);
+
+    // Conservative box test: OUTSIDE only if the box lies entirely behind one of the planes
+    Visibility Classify(const Bounds& bounds) const;
+
+private:
+    std::array<glm::vec4, 6> planes;        // (n, d) with n . p + d >= 0 inside
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "generator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "loader.hpp"
+
+#include "../thirdparty/glm/glm.hpp"
+
+namespace
+{
+    // xorshift64*; unlike std:: distributions its output does not depend on the standard library
+    class Random
+    {
+    public:
+        Random(uint32_t seed) : state(0x9E3779B97F4A7C15ull ^ (uint64_t(seed) << 1 | 1)) {  }
+
+        // uniform in [0, 1)
+        inline float Next()
+        {
+            this->state ^= this->state >> 12;
+            this->state ^= this->state << 25;
+            this->state ^= this->state >> 27;
+            return static_cast<float>((this->state * 0x2545F4914F6CDD1Dull) >> 40) * (1.f / 16777216.f);
+        }
+        inline float Next(float lo, float hi) { return lo + (hi - lo) * this->Next(); }
+        inline glm::vec3 NextVec3(float lo, float hi) { return glm::vec3(this->Next(lo, hi), this->Next(lo, hi), this->Next(lo, hi)); }
+
+    private:
+        uint64_t state;
+    };
+
+    class ShapeBuilder
+    {
+    public:
+        ShapeBuilder(MeshData& mesh, std::string name) : mesh(mesh)
+        {
+            this->shape.name = name;
+        }
+
+        uint32_t AddVertex(glm::vec3 pos)
+        {
+            std::vector<tinyobj::real_t>& vertices = this->mesh.attribs.vertices;
+            uint32_t index = static_cast<uint32_t>(vertices.size() / 3);
+            vertices.insert(vertices.end(), { pos.x, pos.y, pos.z });
+            return index;
+        }
+
+        uint32_t AddNormal(glm::vec3 normal)
+        {
+            std::vector<tinyobj::real_t>& normals = this->mesh.attribs.normals;
+            uint32_t index = static_cast<uint32_t>(normals.size() / 3);
+            normals.insert(normals.end(), { normal.x, normal.y, normal.z });
+            return index;
+        }
+
+        void AddFace(std::array<uint32_t, 3> vertices, std::array<uint32_t, 3> normals)
+        {
+            for (size_t v = 0; v != 3; ++v)
+            {
+                tinyobj::index_t index;
+                index.vertex_index = static_cast<int>(vertices[v]);
+                index.normal_index = static_cast<int>(normals[v]);
+                index.texcoord_index = -1;
+                this->shape.mesh.indices.push_back(index);
+            }
+            this->shape.mesh.num_face_vertices.push_back(3);
+            this->shape.mesh.material_ids.push_back(-1);
+            this->shape.mesh.smoothing_group_ids.push_back(0);
+        }
+
+        // A triangle with its own vertices and a flat normal
+        void AddFlatTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+        {
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float length = glm::length(n);
+            uint32_t normal = this->AddNormal(length > 0.f ? n / length : glm::vec3(0.f, 0.f, 1.f));
+            this->AddFace({ this->AddVertex(a), this->AddVertex(b), this->AddVertex(c) }, { normal, normal, normal });
+        }
+
+        void Reserve(size_t faces, size_t vertices, size_t normals)
+        {
+            this->shape.mesh.indices.reserve(3 * faces);
+            this->shape.mesh.num_face_vertices.reserve(faces);
+            this->shape.mesh.material_ids.reserve(faces);
+            this->shape.mesh.smoothing_group_ids.reserve(faces);
+            this->mesh.attribs.vertices.reserve(this->mesh.attribs.vertices.size() + 3 * vertices);
+            this->mesh.attribs.normals.reserve(this->mesh.attribs.normals.size() + 3 * normals);
+        }
+
+        void Finish() { this->mesh.shapes.push_back(std::move(this->shape)); }
+
+    private:
+        MeshData& mesh;
+        tinyobj::shape_t shape;
+    };
+
+    void GenerateSphere(ShapeBuilder& builder, const GeneratorConfig& config)
+    {
+        const float t = (1.f + std::sqrt(5.f)) / 2.f;
+        const std::array<glm::vec3, 12> ico = {
+            glm::vec3(-1, t, 0), glm::vec3(1, t, 0), glm::vec3(-1, -t, 0), glm::vec3(1, -t, 0),
+            glm::vec3(0, -1, t), glm::vec3(0, 1, t), glm::vec3(0, -1, -t), glm::vec3(0, 1, -t),
+            glm::vec3(t, 0, -1), glm::vec3(t, 0, 1), glm::vec3(-t, 0, -1), glm::vec3(-t, 0, 1)
+        };
+        const std::array<std::array<uint32_t, 3>, 20> faces = {{
+            { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+            { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+            { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+            { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+        }};
+
+        // Each icosahedron face is split into an n x n triangular grid and projected onto the sphere.
+        //   Vertices are shared inside a face only, which keeps generation a single pass without a lookup
+        const uint32_t n = 1u << std::min(config.subdivisions, GeneratorConfig::MAX_SUBDIVISIONS);
+        const size_t faceVertices = size_t(n + 1) * (n + 2) / 2;
+        builder.Reserve(20 * size_t(n) * n, 20 * faceVertices, 20 * faceVertices);
+
+        std::vector<uint32_t> rowStart(n + 2);
+        for (const auto& face : faces)
+        {
+            glm::vec3 a = ico[face[0]], b = ico[face[1]], c = ico[face[2]];
+            uint32_t first = 0;
+            for (uint32_t i = 0; i <= n; ++i)
+            {
+                for (uint32_t j = 0; j <= n - i; ++j)
+                {
+                    glm::vec3 p = a + (b - a) * (static_cast<float>(i) / n) + (c - a) * (static_cast<float>(j) / n);
+                    glm::vec3 dir = glm::normalize(p);
+                    uint32_t index = builder.AddVertex(dir * config.size);
+                    builder.AddNormal(dir);
+                    if (i == 0 && j == 0)
+                        first = index;
+                }
+            }
+
+            // vertex (i, j) of this face, with rows getting shorter by one
+            for (uint32_t i = 0, start = first; i <= n + 1; ++i)
+            {
+                rowStart[i] = start;
+                start += n + 1 - i;
+            }
+            for (uint32_t i = 0; i < n; ++i)
+                for (uint32_t j = 0; j < n - i; ++j)
+                {
+                    uint32_t v0 = rowStart[i] + j, v1 = rowStart[i + 1] + j, v2 = rowStart[i] + j + 1;
+                    builder.AddFace({ v0, v1, v2 }, { v0, v1, v2 });
+                    if (j + 1 < n - i)
+                    {
+                        uint32_t v3 = rowStart[i + 1] + j + 1;
+                        builder.AddFace({ v2, v1, v3 }, { v2, v1, v3 });
+                    }
+                }
+        }
+    }
+
+    void GenerateSoup(ShapeBuilder& builder, const GeneratorConfig& config)
+    {
+        Random random(config.seed);
+        builder.Reserve(config.count, 3 * size_t(config.count), config.count);
+        for (uint32_t i = 0; i != config.count; ++i)
+        {
+            glm::vec3 center = random.NextVec3(-1.f, 1.f);
+            glm::vec3 a = center + random.NextVec3(-0.5f, 0.5f) * config.size;
+            glm::vec3 b = center + random.NextVec3(-0.5f, 0.5f) * config.size;
+            glm::vec3 c = center + random.NextVec3(-0.5f, 0.5f) * config.size;
+            builder.AddFlatTriangle(a, b, c);
+        }
+    }
+
+    void GeneratePlanes(ShapeBuilder& builder, const GeneratorConfig& config)
+    {
+        // planes are spread over a depth of 1, back to front so that every plane passes the depth test
+        const float spacing = config.count > 1 ? 1.f / static_cast<float>(config.count - 1) : 0.f;
+        const float s = config.size;
+        builder.Reserve(2 * size_t(config.count), 4 * size_t(config.count), 1);
+        uint32_t normal = builder.AddNormal(glm::vec3(0.f, 0.f, 1.f));
+        for (uint32_t i = 0; i != config.count; ++i)
+        {
+            float z = -1.f + spacing * static_cast<float>(i);
+            uint32_t v0 = builder.AddVertex(glm::vec3(-s, -s, z));
+            uint32_t v1 = builder.AddVertex(glm::vec3(s, -s, z));
+            uint32_t v2 = builder.AddVertex(glm::vec3(s, s, z));
+            uint32_t v3 = builder.AddVertex(glm::vec3(-s, s, z));
+            builder.AddFace({ v0, v1, v2 }, { normal, normal, normal });
+            builder.AddFace({ v0, v2, v3 }, { normal, normal, normal });
+        }
+    }
+
+    void GenerateSlivers(ShapeBuilder& builder, const GeneratorConfig& config)
+    {
+        Random random(config.seed);
+        builder.Reserve(config.count, 3 * size_t(config.count), config.count);
+        for (uint32_t i = 0; i != config.count; ++i)
+        {
+            glm::vec3 center = random.NextVec3(-1.f, 1.f);
+            float angle = random.Next(0.f, 6.2831853f);
+            glm::vec3 along(std::cos(angle), std::sin(angle), 0.f);
+            glm::vec3 across(-along.y, along.x, 0.f);
+
+            glm::vec3 a = center - along * (0.5f * config.size);
+            glm::vec3 b = center + along * (0.5f * config.size);
+            glm::vec3 c = center + across * (1e-3f * config.size);
+            builder.AddFlatTriangle(a, b, c);
+        }
+    }
+}
+
+std::string GeneratorConfig::Info() const
+{
+    switch (this->type)
+    {
+    case GeneratorType::SPHERE:
+        return "sphere (" + std::to_string(20ull << (2 * std::min(this->subdivisions, MAX_SUBDIVISIONS))) + " triangles)";
+    case GeneratorType::SOUP:
+        return "soup (" + std::to_string(this->count) + " triangles)";
+    case GeneratorType::PLANES:
+        return "planes (" + std::to_string(2ull * this->count) + " triangles)";
+    case GeneratorType::SLIVERS:
+        return "slivers (" + std::to_string(this->count) + " triangles)";
+    }
+    return "unknown";
+}
+
+std::shared_ptr<MeshData> GenerateMesh(const std::vector<GeneratorConfig>& configs)
+{
+    auto mesh = std::make_shared<MeshData>();
+    for (size_t i = 0; i != configs.size(); ++i)
+    {
+        const GeneratorConfig& config = configs[i];
+        static const char* names[] = { "sphere", "soup", "planes", "slivers" };
+        ShapeBuilder builder(*mesh, names[static_cast<size_t>(config.type)] + std::string("_") + std::to_string(i));
+
+        if (config.type == GeneratorType::SPHERE)
+            GenerateSphere(builder, config);
+        else if (config.type == GeneratorType::SOUP)
+            GenerateSoup(builder, config);
+        else if (config.type == GeneratorType::PLANES)
+            GeneratePlanes(builder, config);
+        else
+            GenerateSlivers(builder, config);
+        builder.Finish();
+    }
+    return mesh;
+}
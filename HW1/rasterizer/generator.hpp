@@ -0,0 +1,38 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Procedural meshes for load testing, produced in memory in the same layout as a parsed OBJ
+
+struct MeshData;
+
+enum class GeneratorType
+{
+    SPHERE,             // icosphere, every face split into 4^subdivisions triangles
+    SOUP,               // `count` randomly placed and oriented triangles inside [-1, 1]^3
+    PLANES,             // `count` overlapping screen-facing quads stacked along -z (heavy overdraw)
+    SLIVERS             // `count` long, nearly degenerate triangles
+};
+
+struct GeneratorConfig
+{
+    static constexpr uint32_t MAX_SUBDIVISIONS = 11;      // 84M triangles
+
+
+    GeneratorType type = GeneratorType::SPHERE;
+    uint32_t count = 1;
+    uint32_t subdivisions = 4;
+    float size = 1.f;                   // sphere radius, plane half extent, triangle edge or sliver length
+    uint32_t seed = 1;                  // the same seed yields the same mesh on every platform
+
+    std::string Info() const;
+};
+
+// Build one shape per config. Shapes are named after their generator and carry no material
+std::shared_ptr<MeshData> GenerateMesh(const std::vector<GeneratorConfig>& configs);
+
+#endif
@@ -10,17 +10,33 @@
 #include "../thirdparty/stb/stb_image.h"
 #include "../thirdparty/stb/stb_image_write.h"
 
-Color Color::White = Color(255, 255, 255, 255);
-Color Color::Black = Color(0, 0, 0, 255);
+const Color Color::White = Color(255, 255, 255, 255);
+const Color Color::Black = Color(0, 0, 0, 255);
 
+// Row 0 of a canvas is the bottom of the image, while a .png starts at the top. Rather than setting the global
+//   stbi_flip_vertically_on_write, which would race between images written concurrently, the rows are handed
+//   over from the last one with a negative stride
+static int WriteFlippedPng(const std::string& filename, uint32_t width, uint32_t height, const Color* canvas)
+{
+    if (width == 0 || height == 0)
+        return 0;
+    const Color* top = canvas + static_cast<size_t>(height - 1) * width;
+    return stbi_write_png(filename.c_str(), width, height, 4, top, -static_cast<int>(width * sizeof(Color)));
+}
+
+// Channels are converted through unsigned char: a float above 127 does not fit a (signed) char, and the
+//   compiler was free to saturate it, which turned White and the alpha of Black into 127 in optimized builds
 Color::Color() : 
-    r(static_cast<char>(0)), g(static_cast<char>(0)), b(static_cast<char>(0)), a(static_cast<char>(255)) {     }
+    r(static_cast<unsigned char>(0)), g(static_cast<unsigned char>(0)), b(static_cast<unsigned char>(0)),
+    a(static_cast<unsigned char>(255)) {     }
 
 Color::Color(float grey) : 
-    r(static_cast<char>(grey)), g(static_cast<char>(grey)), b(static_cast<char>(grey)), a(static_cast<char>(255)) {  }
+    r(static_cast<unsigned char>(grey)), g(static_cast<unsigned char>(grey)), b(static_cast<unsigned char>(grey)),
+    a(static_cast<unsigned char>(255)) {  }
 
 Color::Color(float r, float g, float b, float a) :
-    r(static_cast<char>(r)), g(static_cast<char>(g)), b(static_cast<char>(b)), a(static_cast<char>(a)) {  }
+    r(static_cast<unsigned char>(r)), g(static_cast<unsigned char>(g)), b(static_cast<unsigned char>(b)),
+    a(static_cast<unsigned char>(a)) {  }
 
 Color::Color(glm::vec4& v) : Color({ v.x, v.y, v.z, v.w }) {  }
 
@@ -97,10 +113,9 @@ void ImageBuffer<Color>::Write()
 {
     std::string resStr = std::to_string(this->width) + "x" + std::to_string(this->height);
     std::cout << "Writing to PNG with resolution " << resStr << " for colored images.\n";
-    stbi_flip_vertically_on_write(true);
-    
+
     int info;
-    info = stbi_write_png((filename + ".png").c_str(), this->width, this->height, 4, this->canvas, 0);
+    info = WriteFlippedPng(filename + ".png", this->width, this->height, this->canvas);
     if (!info)
         std::cerr << "Writing to " << filename << ".png failed." << std::endl;
 }
@@ -110,7 +125,6 @@ void ImageBuffer<float>::Write()
 {
     std::string resStr = std::to_string(this->width) + "x" + std::to_string(this->height);
     std::cout << "Writing to PNG with resolution " << resStr << " for greyscale images.\n";
-    stbi_flip_vertically_on_write(true);
 
     Color* colorCanvas = new Color[this->width * this->height];
 
@@ -123,7 +137,7 @@ void ImageBuffer<float>::Write()
     }
     
     int info;
-    info = stbi_write_png((filename + ".png").c_str(), this->width, this->height, 4, colorCanvas, 0);
+    info = WriteFlippedPng(filename + ".png", this->width, this->height, colorCanvas);
     if (!info)
         std::cerr << "Writing to " << filename << ".png failed." << std::endl;
 
@@ -28,8 +28,8 @@ public:
     const char operator[] (size_t index) const;
 
     // Clearing colors
-    static Color White;
-    static Color Black;
+    static const Color White;
+    static const Color Black;
 };
 
 inline Color operator+ (const Color& c1, const Color& c2)
@@ -80,11 +80,22 @@ public:
     void Set(uint32_t w, uint32_t h, T);
     std::optional<T> Get(uint32_t w, uint32_t h) const;
 
+    // Set every pixel of the canvas to the same value
+    void Fill(T);
+    // Set the pixels from (xmin, ymin) to (xmax, ymax), both included and clipped to the canvas
+    void Fill(T, uint32_t xmin, uint32_t ymin, uint32_t xmax, uint32_t ymax);
+
     // Write the canvas to a .png file with the designated filename
     void Write();
 
+    inline void SetFilename(std::string filename) { this->filename = filename; }
+    inline const std::string& GetFilename() const { return this->filename; }
+
     inline uint32_t GetWidth() const { return width; }
     inline uint32_t GetHeight() const { return height; }
+
+    // The canvas, `width * height` values row by row from the bottom row up (Write flips it for the .png)
+    inline const T* Data() const { return canvas; }
 };
 
 using Image = ImageBuffer<Color>;
@@ -122,7 +133,7 @@ template<>
 ImageBuffer<Color>::ImageBuffer(unsigned int w, unsigned int h, std::string filename);
 
 template<typename T>
-ImageBuffer<T>::ImageBuffer(const ImageBuffer<T>& image)
+ImageBuffer<T>::ImageBuffer(const ImageBuffer<T>& image) : canvas(nullptr)
 {
     *this = image;
 }
@@ -137,14 +148,15 @@ ImageBuffer<T>::~ImageBuffer()
 template<typename T>
 ImageBuffer<T>& ImageBuffer<T>::operator= (const ImageBuffer<T>& image)
 {
+    if (this == &image)
+        return *this;
     if (this->canvas)
         delete[] canvas;
 
     this->width = image.width;
     this->height = image.height;
-    this->canvas = new T[image.width * image.height];
-    for (unsigned int i = 0; i != image.width * image.height; ++i)
-        this->canvas[i] = image.canvas[i];
+    this->canvas = new T[static_cast<size_t>(image.width) * image.height];
+    std::copy(image.canvas, image.canvas + static_cast<size_t>(image.width) * image.height, this->canvas);
     this->filename = image.filename;
 
     return *this;
@@ -157,6 +169,29 @@ void ImageBuffer<T>::Set(unsigned int w, unsigned int h, T c)
         this->canvas[(size_t)(h * this->width + w)] = c;
 }
 
+template<typename T>
+void ImageBuffer<T>::Fill(T c)
+{
+    if (this->canvas)
+        std::fill(this->canvas, this->canvas + static_cast<size_t>(this->width) * this->height, c);
+}
+
+template<typename T>
+void ImageBuffer<T>::Fill(T c, uint32_t xmin, uint32_t ymin, uint32_t xmax, uint32_t ymax)
+{
+    if (!this->canvas || this->width == 0 || this->height == 0)
+        return;
+    xmax = std::min(xmax, this->width - 1);
+    ymax = std::min(ymax, this->height - 1);
+    if (xmin > xmax)
+        return;
+    for (uint32_t y = ymin; y <= ymax; ++y)
+    {
+        T* row = this->canvas + static_cast<size_t>(y) * this->width;
+        std::fill(row + xmin, row + xmax + 1, c);
+    }
+}
+
 template<typename T>
 std::optional<T> ImageBuffer<T>::Get(unsigned int w, unsigned int h) const
 {
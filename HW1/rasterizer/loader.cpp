@@ -1,8 +1,18 @@
 #include "loader.hpp"
 
+#include <algorithm>
 #include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <unordered_map>
+
+#include "assetcache.hpp"
+#include "meshcache.hpp"
+#include "objparallel.hpp"
+#include "scene.hpp"
+#include "simplify.hpp"
 
 #include "../thirdparty/fkyaml/node.hpp"
 
@@ -96,12 +106,26 @@ void LoadQuat(const fkyaml::node& parent, std::string tag, glm::quat& quat)
 #define LOAD_COLOR_FROM_YAML(node, tag, vec)    LoadColor(node, #tag, vec);
 #define LOAD_QUAT_FROM_YAML(node, tag, vec)     LoadQuat(node, #tag, vec);
 
+void LoadTransforms(const fkyaml::node& transformNode, std::vector<MeshTransform>& transforms)
+{
+    for (auto& subnode : transformNode)
+    {
+        glm::quat rotation;
+        glm::vec3 translation, scale;
+        LOAD_QUAT_FROM_YAML(subnode, rotation, rotation)
+        LOAD_VEC3_FROM_YAML(subnode, translation, translation)
+        LOAD_VEC3_FROM_YAML(subnode, scale, scale)
+        glm::vec3 scale3(scale);
+        transforms.emplace_back(rotation, translation, scale3);
+    }
+}
+
 Loader::Loader(std::string filename) : Loader() 
 {
     this->filename = filename;
 }
 
-bool Loader::Load()
+bool Loader::Load(AssetCache* cache)
 {
     bool yamlSuccess = LoadYaml();
     if (!yamlSuccess)
@@ -111,17 +135,76 @@ bool Loader::Load()
     }
     else 
     {
-        bool objSuccess = LoadObj();
+        bool objSuccess = LoadObj(cache);
         if (!objSuccess)
         {
             std::cerr << "fail loading obj. Quit.\n";
             return false;
         }
+        else if (!ResolveInstances())
+        {
+            std::cerr << "fail resolving instances. Quit.\n";
+            return false;
+        }
         else
             return true;    
     }
 }
 
+bool Loader::Load(const SceneView& view, std::shared_ptr<const MeshData> mesh)
+{
+    // the same checks as LoadYaml, for the entries a view can hold
+    this->type = view.type;
+    if (view.type != TestType::TRANSFORM && view.type != TestType::SHADING_DEPTH && view.type != TestType::SHADING)
+    {
+        std::cerr << "in-memory scenes support the transform, shading-depth and shading tasks only" << std::endl;
+        this->type = TestType::ERROR;
+    }
+    else if (view.width == 0 || view.height == 0 || view.width > 4096 || view.height > 4096)
+    {
+        std::cerr << "invalid resolution: width/height must be in [1, 4096]" << std::endl;
+        this->type = TestType::ERROR;
+    }
+    else if (!mesh)
+    {
+        std::cerr << "in-memory scene has no mesh" << std::endl;
+        this->type = TestType::ERROR;
+    }
+
+    this->mesh = mesh;
+    this->width = view.width;
+    this->height = view.height;
+    this->camera = view.camera;
+    this->transforms = view.transforms;
+    this->instances = view.instances;
+    this->lights = view.lights;
+    this->specularExponent = view.specularExponent;
+    this->ambientColor = view.ambientColor;
+    this->culling = view.options.culling;
+    this->sort = view.options.sort;
+    this->earlyZ = view.options.earlyZ;
+    this->fixedPoint = view.options.fixedPoint;
+    this->traversal = view.options.traversal;
+    this->depthFormat = view.options.depthFormat;
+    this->occlusion = view.options.occlusion;
+    this->ssao = view.options.ssao;
+    this->baseCamera = this->camera;
+    this->baseTransforms = this->transforms;
+    this->modelName = "<memory>";
+    this->outputName = "output";
+
+    if (this->type != TestType::ERROR && !ResolveInstances())
+        this->type = TestType::ERROR;
+    if (this->type == TestType::ERROR)
+    {
+        this->width = 0;
+        this->height = 0;
+        this->outputName = "__error";
+        return false;
+    }
+    return true;
+}
+
 bool Loader::LoadYaml()
 {
     // If the loader fails in any way, the resulting object must have TestType::ERROR
@@ -167,9 +250,160 @@ bool Loader::LoadYaml()
         if (width > MAX_RES || height > MAX_RES)
             throw fkyaml::exception("invalid resolution: width/height exceeding 4096");
 
-        // obj/output filename
-        LOAD_DATA_FROM_YAML(this->modelName, root, obj, std::string)
+        // obj/output filename; a config may generate its geometry instead of naming an obj
+        if (root.contains("generate"))
+        {
+            for (auto& subnode : root["generate"])
+            {
+                GeneratorConfig generator;
+                LOAD_DEF_DATA_FROM_YAML(type, subnode, type, std::string)
+                if (type == "sphere")
+                    generator.type = GeneratorType::SPHERE;
+                else if (type == "soup")
+                    generator.type = GeneratorType::SOUP;
+                else if (type == "planes")
+                    generator.type = GeneratorType::PLANES;
+                else if (type == "slivers")
+                    generator.type = GeneratorType::SLIVERS;
+                else
+                {
+                    std::string msg = "cannot recognize generator type " + type;
+                    throw fkyaml::exception(msg.c_str());
+                }
+
+                if (subnode.contains("count"))
+                    generator.count = subnode["count"].get_value<uint32_t>();
+                if (subnode.contains("subdivisions"))
+                    generator.subdivisions = subnode["subdivisions"].get_value<uint32_t>();
+                if (subnode.contains("size"))
+                    generator.size = subnode["size"].get_value<float>();
+                if (subnode.contains("seed"))
+                    generator.seed = subnode["seed"].get_value<uint32_t>();
+
+                if (generator.subdivisions > GeneratorConfig::MAX_SUBDIVISIONS)
+                    throw fkyaml::exception("sphere subdivisions exceeding 11");
+                this->generators.push_back(generator);
+            }
+            if (this->generators.empty())
+                throw fkyaml::exception("generate requires at least one entry");
+
+            this->modelName = "<generated>";
+            for (const GeneratorConfig& generator : this->generators)
+                this->modelName += " " + generator.Info();
+        }
+        else
+            LOAD_DATA_FROM_YAML(this->modelName, root, obj, std::string)
         LOAD_DATA_FROM_YAML(this->outputName, root, output, std::string)
+        if (root.contains("meshCache"))
+            this->useMeshCache = root["meshCache"].get_value<bool>();
+        if (root.contains("culling"))
+            this->culling = root["culling"].get_value<bool>();
+        if (root.contains("sort"))
+            this->sort = root["sort"].get_value<bool>();
+        if (root.contains("earlyZ"))
+            this->earlyZ = root["earlyZ"].get_value<bool>();
+        if (root.contains("progressive"))
+            this->progressive = root["progressive"].get_value<bool>();
+        if (root.contains("transparency"))
+            this->transparency = root["transparency"].get_value<bool>();
+        if (root.contains("fixedPoint"))
+            this->fixedPoint = root["fixedPoint"].get_value<bool>();
+        if (root.contains("traversal"))
+        {
+            std::string traversalName = root["traversal"].get_value<std::string>();
+            if (traversalName == "box")
+                this->traversal = Traversal::BOX;
+            else if (traversalName == "scanline")
+                this->traversal = Traversal::SCANLINE;
+            else if (traversalName == "tiled")
+                this->traversal = Traversal::TILED;
+            else if (traversalName == "auto")
+                this->traversal = Traversal::AUTO;
+            else
+                throw fkyaml::exception(("unknown traversal " + traversalName).c_str());
+        }
+        if (root.contains("depthFormat"))
+        {
+            std::string formatName = root["depthFormat"].get_value<std::string>();
+            if (formatName == "float")
+                this->depthFormat = DepthFormat::FLOAT;
+            else if (formatName == "reversed")
+                this->depthFormat = DepthFormat::REVERSED;
+            else if (formatName == "unorm24")
+                this->depthFormat = DepthFormat::UNORM24;
+            else
+                throw fkyaml::exception(("unknown depthFormat " + formatName).c_str());
+        }
+
+        // lod: either a bool, or a mapping overriding the defaults of LodConfig
+        if (root.contains("lod"))
+        {
+            auto lodNode = root["lod"];
+            if (lodNode.is_boolean())
+                this->lod.enabled = lodNode.get_value<bool>();
+            else
+            {
+                this->lod.enabled = true;
+                if (lodNode.contains("levels"))
+                    this->lod.levels = lodNode["levels"].get_value<uint32_t>();
+                if (lodNode.contains("ratio"))
+                    this->lod.ratio = lodNode["ratio"].get_value<float>();
+                if (lodNode.contains("pixelError"))
+                    this->lod.pixelError = lodNode["pixelError"].get_value<float>();
+            }
+            if (this->lod.ratio <= 0.f || this->lod.ratio >= 1.f)
+                throw fkyaml::exception("lod ratio must be in (0, 1)");
+        }
+
+        // occlusion: either a bool, or a mapping overriding the defaults of OcclusionConfig
+        if (root.contains("occlusion"))
+        {
+            auto occlusionNode = root["occlusion"];
+            if (occlusionNode.is_boolean())
+                this->occlusion.enabled = occlusionNode.get_value<bool>();
+            else
+            {
+                this->occlusion.enabled = true;
+                if (occlusionNode.contains("occluderArea"))
+                    this->occlusion.occluderArea = occlusionNode["occluderArea"].get_value<float>();
+            }
+        }
+
+        // ssao: either a bool, or a mapping overriding the defaults of AmbientOcclusionConfig
+        if (root.contains("ssao"))
+        {
+            auto ssaoNode = root["ssao"];
+            if (ssaoNode.is_boolean())
+                this->ssao.enabled = ssaoNode.get_value<bool>();
+            else
+            {
+                this->ssao.enabled = true;
+                if (ssaoNode.contains("radius"))
+                    this->ssao.radius = ssaoNode["radius"].get_value<float>();
+                if (ssaoNode.contains("samples"))
+                    this->ssao.samples = ssaoNode["samples"].get_value<uint32_t>();
+                if (ssaoNode.contains("intensity"))
+                    this->ssao.intensity = ssaoNode["intensity"].get_value<float>();
+                if (ssaoNode.contains("threads"))
+                    this->ssao.threads = ssaoNode["threads"].get_value<uint32_t>();
+            }
+            if (!(this->ssao.radius > 0.f))
+                throw fkyaml::exception("ssao radius must be positive");
+        }
+
+        // profile: either a bool, or a mapping with an optional trace file
+        if (root.contains("profile"))
+        {
+            auto profileNode = root["profile"];
+            if (profileNode.is_boolean())
+                this->profile.enabled = profileNode.get_value<bool>();
+            else
+            {
+                this->profile.enabled = true;
+                if (profileNode.contains("trace"))
+                    this->profile.trace = profileNode["trace"].get_value<std::string>();
+            }
+        }
 
         // If the task is TRANSFORM or SHADING, then there must be a camera; load it
         if (this->type != TestType::TRIANGLE)
@@ -187,16 +421,25 @@ bool Loader::LoadYaml()
             // Load Transforms
             LOAD_NODE_FROM_YAML_NOERROR(transformNode, root, transforms)
             if (transformNode != root)
+                LoadTransforms(transformNode, this->transforms);
+
+            // Load instances: shapes drawn once per listed transform
+            if (root.contains("instances"))
             {
-                for (auto& subnode : transformNode)
+                if (this->type == TestType::TRANSFORM_TEST)
+                    throw fkyaml::exception("instances are not supported for transform-test");
+
+                for (auto& subnode : root["instances"])
                 {
-                    glm::quat rotation;
-                    glm::vec3 translation, scale;
-                    LOAD_QUAT_FROM_YAML(subnode, rotation, rotation)
-                    LOAD_VEC3_FROM_YAML(subnode, translation, translation)
-                    LOAD_VEC3_FROM_YAML(subnode, scale, scale)
-                    glm::vec3 scale3(scale);
-                    this->transforms.emplace_back(rotation, translation, scale3);
+                    InstanceGroup group;
+                    LOAD_NODE_FROM_YAML(shapeNode, subnode, shape)
+                    if (shapeNode.is_integer())
+                        group.shape = shapeNode.get_value<int64_t>();
+                    else
+                        group.shapeName = shapeNode.get_value<std::string>();
+                    LOAD_NODE_FROM_YAML(instanceNode, subnode, transforms)
+                    LoadTransforms(instanceNode, group.transforms);
+                    this->instances.push_back(std::move(group));
                 }
             }
 
@@ -221,6 +464,44 @@ bool Loader::LoadYaml()
                 LOAD_DATA_FROM_YAML(this->specularExponent, root, exponent, float)
                 LOAD_COLOR_FROM_YAML(root, ambient, this->ambientColor)
             }
+
+            // Load the optional animation; keyframes fall back to the camera/transforms above
+            this->baseCamera = this->camera;
+            this->baseTransforms = this->transforms;
+            if (root.contains("animation"))
+            {
+                if (this->type == TestType::TRANSFORM_TEST)
+                    throw fkyaml::exception("animation is not supported for transform-test");
+
+                auto animationNode = root["animation"];
+                LOAD_DATA_FROM_YAML(this->animation.frames, animationNode, frames, uint32_t)
+                if (animationNode.contains("pipelineWrite"))
+                    this->animation.pipelineWrite = animationNode["pipelineWrite"].get_value<bool>();
+
+                LOAD_NODE_FROM_YAML(keyframeNode, animationNode, keyframes)
+                for (auto& subnode : keyframeNode)
+                {
+                    LOAD_DEF_DATA_FROM_YAML(frame, subnode, frame, uint32_t)
+                    Keyframe keyframe(frame);
+                    if (subnode.contains("camera"))
+                    {
+                        auto keyCameraNode = subnode["camera"];
+                        Camera keyCamera = this->camera;
+                        LOAD_VEC3_FROM_YAML(keyCameraNode, pos, keyCamera.pos)
+                        LOAD_VEC3_FROM_YAML(keyCameraNode, lookAt, keyCamera.lookAt)
+                        LOAD_VEC3_FROM_YAML(keyCameraNode, up, keyCamera.up)
+                        keyframe.camera = keyCamera;
+                    }
+                    if (subnode.contains("transforms"))
+                        LoadTransforms(subnode["transforms"], keyframe.transforms);
+                    this->animation.keyframes.push_back(std::move(keyframe));
+                }
+
+                if (this->animation.keyframes.empty())
+                    throw fkyaml::exception("animation requires at least one keyframe");
+                std::stable_sort(this->animation.keyframes.begin(), this->animation.keyframes.end(),
+                    [](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+            }
         }
         else if (this->type == TestType::TRIANGLE)
         // if the task is TRIANGLE, then need to check whether it is SSAA
@@ -267,29 +548,427 @@ bool Loader::LoadYaml()
     return true;
 }
 
-bool Loader::LoadObj()
+const MeshData& Loader::GetMesh() const
+{
+    static const MeshData empty;
+    return this->mesh ? *this->mesh : empty;
+}
+
+bool Loader::LoadObj(AssetCache* cache)
 {
-    std::string filename = this->modelName + ".obj";
-    tinyobj::ObjReaderConfig readerConfig;
-    readerConfig.mtl_search_path = "./";
-    readerConfig.triangulate = true;
-    readerConfig.triangulation_method = "earcut";
-    readerConfig.vertex_color = true;
+    // generated meshes never touch the disk, and are cheap enough to rebuild per config
+    if (!this->generators.empty())
+    {
+        std::shared_ptr<MeshData> generated = GenerateMesh(this->generators);
+        IndexShapes(*generated);
+        if (this->lod.enabled)
+            BuildLods(*generated, this->lod);
+        this->mesh = generated;
+        return true;
+    }
 
-    tinyobj::ObjReader reader;
+    this->mesh = cache ? cache->GetMesh(this->modelName, this->useMeshCache, this->lod) :
+        Loader::LoadMesh(this->modelName, this->useMeshCache, this->lod);
+    return this->mesh != nullptr;
+}
+
+std::shared_ptr<const MeshData> Loader::LoadMesh(const std::string& modelName, bool useMeshCache, const LodConfig& lod)
+{
+    std::string filename = modelName + ".obj";
+    const std::string searchPath = "./";
 
-    if (!reader.ParseFromFile(filename, readerConfig)) 
+    std::shared_ptr<MeshData> mesh;
+    if (useMeshCache)
+        mesh = ReadMeshCache(filename, searchPath);
+    if (!mesh)
     {
-        if (!reader.Error().empty()) 
-            std::cerr << "TinyObjReader [ERROR]: " << reader.Error();
-        return false;
+        mesh = ParseObj(filename, searchPath);
+        if (!mesh)
+            return nullptr;
+        if (useMeshCache && !WriteMeshCache(filename, searchPath, *mesh))
+            std::cout << "[WARNING] could not write mesh cache for " << filename << std::endl;
+    }
+
+    LoadTextures(*mesh, searchPath);
+    IndexShapes(*mesh);
+
+    if (lod.enabled)
+    {
+        if (useMeshCache && ReadLodCache(filename, lod, *mesh))
+            IndexLods(*mesh);
+        else
+        {
+            BuildLods(*mesh, lod);
+            if (useMeshCache && !WriteLodCache(filename, lod, *mesh))
+                std::cout << "[WARNING] could not write LOD cache for " << filename << std::endl;
+        }
+    }
+    return mesh;
+}
+
+std::shared_ptr<const MeshData> Loader::BuildMesh(const std::vector<SceneMesh>& meshes)
+{
+    auto mesh = std::make_shared<MeshData>();
+    tinyobj::attrib_t& attribs = mesh->attribs;
+    for (const SceneMesh& source : meshes)
+    {
+        size_t vertices = source.positions.size() / 3;
+        if (source.positions.size() % 3 != 0 || source.indices.size() % 3 != 0 ||
+            (!source.normals.empty() && source.normals.size() != 3 * vertices) ||
+            (!source.uvs.empty() && source.uvs.size() != 2 * vertices))
+        {
+            std::cerr << "mesh " << source.name << " has attribute arrays of mismatched sizes" << std::endl;
+            return nullptr;
+        }
+
+        // the attributes of every mesh follow those of the previous ones, so indices are offset by the vertices before
+        int first = static_cast<int>(attribs.vertices.size() / 3);
+        int firstNormal = static_cast<int>(attribs.normals.size() / 3);
+        int firstUv = static_cast<int>(attribs.texcoords.size() / 2);
+        attribs.vertices.insert(attribs.vertices.end(), source.positions.begin(), source.positions.end());
+        attribs.normals.insert(attribs.normals.end(), source.normals.begin(), source.normals.end());
+        attribs.texcoords.insert(attribs.texcoords.end(), source.uvs.begin(), source.uvs.end());
+
+        tinyobj::shape_t shape;
+        shape.name = source.name;
+        shape.mesh.indices.reserve(source.indices.size());
+        for (uint32_t index : source.indices)
+        {
+            if (index >= vertices)
+            {
+                std::cerr << "mesh " << source.name << " references vertex " << index << " of " << vertices << std::endl;
+                return nullptr;
+            }
+            tinyobj::index_t corner;
+            corner.vertex_index = first + static_cast<int>(index);
+            corner.normal_index = source.normals.empty() ? -1 : firstNormal + static_cast<int>(index);
+            corner.texcoord_index = source.uvs.empty() ? -1 : firstUv + static_cast<int>(index);
+            shape.mesh.indices.push_back(corner);
+        }
+        size_t faces = source.indices.size() / 3;
+        shape.mesh.num_face_vertices.assign(faces, 3);
+        shape.mesh.material_ids.assign(faces, -1);
+        shape.mesh.smoothing_group_ids.assign(faces, 0);
+        mesh->shapes.push_back(std::move(shape));
     }
 
-    if (!reader.Warning().empty()) 
-        std::cout << "TinyObjReader [WARNING]: " << reader.Warning();
+    IndexShapes(*mesh);
+    return mesh;
+}
+
+namespace
+{
+    // Loads .mtl files as tinyobj does, and remembers which were asked for, so that the mesh cache can notice
+    //   edits to them
+    class RecordingMaterialReader : public tinyobj::MaterialReader
+    {
+    public:
+        RecordingMaterialReader(const std::string& searchPath, std::vector<std::string>& libraries) :
+            reader(searchPath), libraries(libraries) {  }
+
+        bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials,
+            std::map<std::string, int>* matMap, std::string* warn, std::string* err) override
+        {
+            if (std::find(this->libraries.begin(), this->libraries.end(), matId) == this->libraries.end())
+                this->libraries.push_back(matId);
+            return this->reader(matId, materials, matMap, warn, err);
+        }
+
+    private:
+        tinyobj::MaterialFileReader reader;
+        std::vector<std::string>& libraries;
+    };
+}
+
+std::shared_ptr<MeshData> Loader::ParseObj(const std::string& filename, const std::string& searchPath)
+{
+    auto mesh = std::make_shared<MeshData>();
+    auto addMaterials = [&mesh](const std::vector<tinyobj::material_t>& materials)
+    {
+        for (const tinyobj::material_t& material : materials)
+        {
+            glm::vec3 diffuse(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+            mesh->materials.emplace_back(material.name, diffuse, material.dissolve, material.diffuse_texname);
+        }
+    };
+
+    // Large files are parsed on every core; small ones keep tinyobj's earcut triangulation
+    std::error_code sizeError;
+    const uintmax_t PARALLEL_THRESHOLD = 16u << 20;
+    if (std::filesystem::file_size(filename, sizeError) >= PARALLEL_THRESHOLD && !sizeError)
+    {
+        tinyobj::ObjReaderConfig readerConfig;
+        readerConfig.mtl_search_path = searchPath;
+        readerConfig.triangulate = true;
+        readerConfig.vertex_color = true;
+
+        ParallelObjReader reader;
+        if (!reader.ParseFromFile(filename, readerConfig))
+        {
+            std::cerr << "ParallelObjReader [ERROR]: " << reader.Error();
+            return nullptr;
+        }
+        if (!reader.Warning().empty()) 
+            std::cout << "TinyObjReader [WARNING]: " << reader.Warning();
+        mesh->attribs = reader.GetAttrib();
+        mesh->shapes = reader.GetShapes();
+        mesh->materialLibraries = reader.GetMaterialLibraries();
+        addMaterials(reader.GetMaterials());
+        return mesh;
+    }
 
-    this->attribs = reader.GetAttrib();
-    this->shapes = reader.GetShapes();
+    // tinyobj::ObjReader, with the material reader swapped for one that records the libraries
+    std::ifstream ifs(filename);
+    if (!ifs)
+    {
+        std::cerr << "TinyObjReader [ERROR]: Cannot open file [" << filename << "]" << std::endl;
+        return nullptr;
+    }
+    RecordingMaterialReader materialReader(searchPath, mesh->materialLibraries);
+    std::vector<tinyobj::material_t> materials;
+    std::string warning, error;
+    bool valid = tinyobj::LoadObj(&mesh->attribs, &mesh->shapes, &materials, &warning, &error, &ifs, &materialReader,
+        true, true);
+    if (!valid) 
+    {
+        if (!error.empty()) 
+            std::cerr << "TinyObjReader [ERROR]: " << error;
+        return nullptr;
+    }
+    if (!warning.empty()) 
+        std::cout << "TinyObjReader [WARNING]: " << warning;
+
+    addMaterials(materials);
+    return mesh;
+}
+
+void Loader::LoadTextures(MeshData& mesh, const std::string& searchPath)
+{
+    // Materials share textures by filename; a texture that fails to load leaves the material untextured
+    std::unordered_map<std::string, int32_t> textureIds;
+    for (Material& material : mesh.materials)
+    {
+        if (material.diffuseTexname.empty())
+            continue;
+
+        auto it = textureIds.find(material.diffuseTexname);
+        if (it == textureIds.end())
+        {
+            int32_t textureId = -1;
+            Texture texture(searchPath + material.diffuseTexname);
+            if (texture.Load())
+            {
+                textureId = static_cast<int32_t>(mesh.textures.size());
+                mesh.textures.push_back(std::move(texture));
+            }
+            it = textureIds.emplace(material.diffuseTexname, textureId).first;
+        }
+        material.diffuseTexture = it->second;
+    }
+}
+
+void Loader::ApplyKeyframe(uint32_t frame)
+{
+    const std::vector<Keyframe>& keyframes = this->animation.keyframes;
+    if (keyframes.empty())
+        return;
+
+    // Find the keyframes bracketing `frame` for each property; properties missing from a keyframe are
+    //   skipped, so a camera-only keyframe does not pin the transforms and vice versa. Before the first keyframe
+    //   of a property, the top level config acts as a keyframe at frame 0; after the last, its value is held
+    auto bracket = [&](auto has) -> std::pair<const Keyframe*, const Keyframe*>
+    {
+        const Keyframe* before = nullptr;
+        const Keyframe* after = nullptr;
+        for (const Keyframe& keyframe : keyframes)
+        {
+            if (!has(keyframe))
+                continue;
+            if (keyframe.frame <= frame)
+                before = &keyframe;
+            else if (!after)
+                after = &keyframe;
+        }
+        return { before, after };
+    };
+    auto factor = [frame](const Keyframe* a, const Keyframe* b)
+    {
+        uint32_t start = a ? a->frame : 0;
+        return b->frame == start ? 0.f : static_cast<float>(frame - start) / static_cast<float>(b->frame - start);
+    };
+
+    auto [camA, camB] = bracket([](const Keyframe& k) { return k.camera.has_value(); });
+    this->camera = this->baseCamera;
+    if (camA && !camB)
+        this->camera = camA->camera.value();
+    else if (camB)
+    {
+        float t = factor(camA, camB);
+        const Camera& a = camA ? camA->camera.value() : this->baseCamera;
+        const Camera& b = camB->camera.value();
+        this->camera.pos = glm::mix(a.pos, b.pos, t);
+        this->camera.lookAt = glm::mix(a.lookAt, b.lookAt, t);
+        this->camera.up = glm::mix(a.up, b.up, t);
+    }
 
+    size_t count = this->baseTransforms.size();
+    for (const Keyframe& keyframe : keyframes)
+        count = std::max(count, keyframe.transforms.size());
+    this->transforms = this->baseTransforms;
+    this->transforms.resize(count, MeshTransform(glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(0.f), glm::vec3(1.f)));
+    for (size_t index = 0; index != this->transforms.size(); ++index)
+    {
+        auto [keyA, keyB] = bracket([index](const Keyframe& k) { return k.transforms.size() > index; });
+        if (!keyB)
+        {
+            if (keyA)
+                this->transforms[index] = keyA->transforms[index];
+            continue;
+        }
+
+        float t = factor(keyA, keyB);
+        const MeshTransform a = keyA ? keyA->transforms[index] : this->transforms[index];
+        const MeshTransform& b = keyB->transforms[index];
+        this->transforms[index] = MeshTransform(
+            glm::slerp(a.rotation, b.rotation, t),
+            glm::mix(a.translation, b.translation, t),
+            glm::mix(a.scale, b.scale, t));
+    }
+}
+
+void Loader::IndexShapes(MeshData& mesh)
+{
+    // `slot` maps a vertex (or normal) index to its position in the current shape's list; it is reset through
+    //   that list after every shape, so the whole pass is linear in the number of indices
+    std::vector<uint32_t> slot(std::max(mesh.attribs.vertices.size(), mesh.attribs.normals.size()) / 3, UINT32_MAX);
+
+    mesh.shapeVertices.resize(mesh.shapes.size());
+    mesh.shapeBounds.resize(mesh.shapes.size());
+    for (size_t s = 0; s != mesh.shapes.size(); ++s)
+        IndexShape(mesh.attribs, mesh.shapes[s], slot, mesh.shapeVertices[s], mesh.shapeBounds[s]);
+}
+
+void Loader::IndexShape(const tinyobj::attrib_t& attribs, const tinyobj::shape_t& shape, std::vector<uint32_t>& slot,
+    ShapeVertices& vertices, ShapeBounds& bounds)
+{
+    auto position = [&attribs](int index)
+    {
+        const tinyobj::real_t* v = &attribs.vertices[3 * size_t(index)];
+        return glm::vec3(v[0], v[1], v[2]);
+    };
+
+    // faces are triangles, so face f starts at index 3 * f
+    bounds = ShapeBounds();
+    size_t faces = shape.mesh.num_face_vertices.size();
+    for (size_t first = 0; first < faces; first += ShapeBounds::CHUNK_FACES)
+    {
+        ShapeBounds::Chunk chunk{ static_cast<uint32_t>(first),
+            static_cast<uint32_t>(std::min<size_t>(ShapeBounds::CHUNK_FACES, faces - first)), Bounds() };
+        for (size_t i = 3 * first; i != 3 * (first + chunk.faceCount); ++i)
+            chunk.bounds.Extend(position(shape.mesh.indices[i].vertex_index));
+        bounds.bounds.Extend(chunk.bounds.min);
+        bounds.bounds.Extend(chunk.bounds.max);
+        bounds.chunks.push_back(chunk);
+    }
+
+    const uint32_t UNUSED = UINT32_MAX;
+    vertices = ShapeVertices();
+    vertices.corners.reserve(shape.mesh.indices.size());
+    for (const tinyobj::index_t& idx : shape.mesh.indices)
+    {
+        uint32_t vertex = static_cast<uint32_t>(idx.vertex_index);
+        if (slot[vertex] == UNUSED)
+        {
+            slot[vertex] = static_cast<uint32_t>(vertices.positions.size());
+            vertices.positions.push_back(vertex);
+        }
+        vertices.corners.push_back(slot[vertex]);
+    }
+    for (uint32_t vertex : vertices.positions)
+        slot[vertex] = UNUSED;
+
+    vertices.normalCorners.reserve(shape.mesh.indices.size());
+    for (const tinyobj::index_t& idx : shape.mesh.indices)
+    {
+        if (idx.normal_index < 0)
+        {
+            vertices.normalCorners.push_back(ShapeVertices::NO_NORMAL);
+            continue;
+        }
+        uint32_t normal = static_cast<uint32_t>(idx.normal_index);
+        if (slot[normal] == UNUSED)
+        {
+            slot[normal] = static_cast<uint32_t>(vertices.normals.size());
+            vertices.normals.push_back(normal);
+        }
+        vertices.normalCorners.push_back(slot[normal]);
+    }
+    for (uint32_t normal : vertices.normals)
+        slot[normal] = UNUSED;
+}
+
+void Loader::BuildLods(MeshData& mesh, const LodConfig& lod)
+{
+    // Each level is simplified from the previous one; a level that cannot reach its target (or removes
+    //   almost nothing) ends the chain, as would anything below a handful of faces. The error of a level is
+    //   measured against the previous one, so the errors add up along the chain
+    const size_t MIN_FACES = 16;
+    mesh.lods.assign(mesh.shapes.size(), {});
+    for (size_t s = 0; s != mesh.shapes.size(); ++s)
+    {
+        const tinyobj::shape_t* source = &mesh.shapes[s];
+        float error = 0.f;
+        for (uint32_t level = 0; level != lod.levels; ++level)
+        {
+            size_t faces = source->mesh.num_face_vertices.size();
+            size_t target = static_cast<size_t>(static_cast<float>(faces) * lod.ratio);
+            if (target < MIN_FACES)
+                break;
+
+            SimplifiedShape simplified = SimplifyShape(mesh.attribs, *source, target);
+            if (simplified.shape.mesh.num_face_vertices.size() > faces * 0.9f)
+                break;
+
+            LodLevel next;
+            next.shape = std::move(simplified.shape);
+            error += simplified.error;
+            next.error = error;
+            mesh.lods[s].push_back(std::move(next));
+            source = &mesh.lods[s].back().shape;
+        }
+    }
+    IndexLods(mesh);
+}
+
+void Loader::IndexLods(MeshData& mesh)
+{
+    std::vector<uint32_t> slot(std::max(mesh.attribs.vertices.size(), mesh.attribs.normals.size()) / 3, UINT32_MAX);
+    for (std::vector<LodLevel>& levels : mesh.lods)
+        for (LodLevel& level : levels)
+            IndexShape(mesh.attribs, level.shape, slot, level.vertices, level.bounds);
+}
+
+bool Loader::ResolveInstances()
+{
+    const std::vector<tinyobj::shape_t>& shapes = this->GetShapes();
+    for (InstanceGroup& group : this->instances)
+    {
+        if (!group.shapeName.empty())
+        {
+            auto found = std::find_if(shapes.begin(), shapes.end(),
+                [&group](const tinyobj::shape_t& shape) { return shape.name == group.shapeName; });
+            if (found == shapes.end())
+            {
+                std::cerr << "instances reference unknown shape " << group.shapeName << std::endl;
+                return false;
+            }
+            group.shape = found - shapes.begin();
+        }
+        if (group.shape < 0 || static_cast<size_t>(group.shape) >= shapes.size())
+        {
+            std::cerr << "instances reference shape " << group.shape << " of " << shapes.size() << std::endl;
+            return false;
+        }
+    }
     return true;
 }
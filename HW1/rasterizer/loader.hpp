@@ -2,10 +2,16 @@
 #define LOADER_H
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <optional>
 
+#include "depthbuffer.hpp"
 #include "entities.hpp"
+#include "generator.hpp"
+#include "raster.hpp"
+#include "ssao.hpp"
+#include "texture.hpp"
 #include "../thirdparty/tinyobj/tiny_obj_fwd.h"
 
 namespace tinyobj
@@ -29,6 +35,96 @@ enum class AntiAliasConfig
     NONE, SSAA
 };
 
+struct AnimationConfig
+{
+    uint32_t frames = 0;                // 0 renders a single still frame
+    bool pipelineWrite = true;          // encode frame N to PNG while frame N + 1 is rasterized
+    std::vector<Keyframe> keyframes;    // sorted by frame
+};
+
+struct ProfileConfig
+{
+    bool enabled = false;               // print per-stage timings and pixel counters after rendering
+    std::string trace;                  // optional Chrome trace (JSON) output file
+};
+
+// Draws one shape of the model once per transform, on top of the per-shape `transforms`
+struct InstanceGroup
+{
+    std::string shapeName;              // shape referenced by name, resolved once the model is loaded
+    int64_t shape = -1;                 // index into the shapes of the model
+    std::vector<MeshTransform> transforms;
+};
+
+// Unique vertices referenced by a shape, so that the vertex stage transforms every position and normal only once
+//   per instance
+struct ShapeVertices
+{
+    static constexpr uint32_t NO_NORMAL = UINT32_MAX;
+
+    std::vector<uint32_t> positions;    // vertex indices into `attribs.vertices` (in units of 3 floats)
+    std::vector<uint32_t> corners;      // for every entry of `mesh.indices`, its slot in `positions`
+    std::vector<uint32_t> normals;      // normal indices into `attribs.normals` (in units of 3 floats)
+    std::vector<uint32_t> normalCorners;    // for every entry of `mesh.indices`, its slot in `normals`, or NO_NORMAL
+};
+
+// Object-space bounds of a shape and of consecutive runs of its faces, used for culling
+struct ShapeBounds
+{
+    static constexpr uint32_t CHUNK_FACES = 256;
+
+    struct Chunk
+    {
+        uint32_t firstFace;
+        uint32_t faceCount;
+        Bounds bounds;
+    };
+
+    Bounds bounds;
+    std::vector<Chunk> chunks;
+};
+
+struct LodConfig
+{
+    bool enabled = false;
+    uint32_t levels = 3;                // simplified levels per shape, in addition to the full shape
+    float ratio = 0.5f;                 // face count of each level relative to the previous one
+    float pixelError = 1.f;             // the coarsest level whose error projects below this many pixels is drawn
+};
+
+struct OcclusionConfig
+{
+    bool enabled = false;
+    float occluderArea = 0.05f;         // draws covering at least this fraction of the screen are drawn first as occluders
+};
+
+// A simplified version of a shape; it references the vertices of the model like the shape itself
+struct LodLevel
+{
+    tinyobj::shape_t shape;
+    float error = 0.f;                  // object-space distance of its vertices to the full shape, see SimplifiedShape
+    ShapeVertices vertices;
+    ShapeBounds bounds;
+};
+
+// Geometry and materials parsed from an OBJ file; immutable once loaded so that it can be
+//   shared between the loaders of every config referencing the same model
+struct MeshData
+{
+    tinyobj::attrib_t attribs;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<Material> materials;
+    std::vector<std::string> materialLibraries;     // .mtl files named by the OBJ, relative to the search path
+    std::vector<Texture> textures;
+    std::vector<ShapeVertices> shapeVertices;       // one per shape
+    std::vector<ShapeBounds> shapeBounds;           // one per shape
+    std::vector<std::vector<LodLevel>> lods;        // per shape, coarser with every level; empty without `lod`
+};
+
+class AssetCache;
+struct SceneMesh;
+struct SceneView;
+
 std::string ToStr(glm::vec4 vec);
 std::string ToStr(glm::vec3 vec);
 
@@ -38,7 +134,27 @@ public:
     Loader() = default;
     Loader(std::string filename);
 
-    bool Load();
+    // Load the config and its model. If `cache` is given, the model is taken from (and added to) the cache
+    //   instead of being parsed again
+    bool Load(AssetCache* cache = nullptr);
+
+    // Load `<modelName>.obj` together with its materials and textures. Returns nullptr on failure.
+    //   With `useMeshCache`, a binary copy of the geometry is kept next to the .obj (see meshcache.hpp)
+    //   and parsing is skipped while the .obj is unchanged
+    //   With `lod` enabled, every shape also gets a chain of simplified levels (cached as `<model>.obj.lodcache`)
+    static std::shared_ptr<const MeshData> LoadMesh(const std::string& modelName, bool useMeshCache = true,
+        const LodConfig& lod = LodConfig());
+
+    // Set up from memory instead of a config file (see scene.hpp), with `mesh` as the model. Returns false, with
+    //   the type set to ERROR, if the view is not a TRANSFORM, SHADING_DEPTH or SHADING task or is incomplete
+    bool Load(const SceneView& view, std::shared_ptr<const MeshData> mesh);
+
+    // Build the geometry of in-memory meshes, one shape each, indexed as a loaded model. Returns nullptr if an
+    //   index or attribute array is out of range
+    static std::shared_ptr<const MeshData> BuildMesh(const std::vector<SceneMesh>& meshes);
+
+    // Replace camera and transforms with the keyframe-interpolated state at `frame`
+    void ApplyKeyframe(uint32_t frame);
 
 
     inline std::string Info() const
@@ -76,8 +192,10 @@ public:
                     transformStr += "|   scale: " + ToStr(transform.scale) + "\n";
                 }
             }
-            if (this->transforms.size() != this->shapes.size())
+            if (this->transforms.size() != this->GetShapes().size() && this->instances.empty())
                 transformStr += "[WARNING] number of transforms does not match number of shapes\n";
+            for (auto& group : this->instances)
+                transformStr += "Instances: shape " + ToStr(group.shape) + " drawn " + ToStr(group.transforms.size()) + " times\n";
         }
 
         std::string lightStr = "<no light needed>\n";
@@ -100,13 +218,56 @@ public:
             }
         }
 
+        std::string animationStr = "";
+        if (this->animation.frames > 0)
+            animationStr = "Animation: " + ToStr(this->animation.frames) + " frames, " +
+                ToStr(this->animation.keyframes.size()) + " keyframes\n";
+
+        std::string lodStr = "";
+        if (this->lod.enabled)
+            lodStr = "LOD: " + ToStr(this->lod.levels) + " levels, ratio " + ToStr(this->lod.ratio) +
+                ", pixel error " + ToStr(this->lod.pixelError) + "\n";
+
+        std::string cullingStr = this->culling ? "Culling: frustum\n" : "";
+        std::string sortStr = this->sort ? "Draw order: front to back\n" : "";
+        std::string earlyZStr = this->earlyZ ? "Early-Z: on\n" : "";
+        std::string progressiveStr = this->progressive ? "Progressive: 1/8, 1/4, 1/2 previews\n" : "";
+        std::string transparencyStr = this->transparency ? "Transparency: on\n" : "";
+        std::string fixedPointStr = this->fixedPoint ? "Coverage: 24.8 fixed point, top-left rule\n" : "";
+        std::string depthFormatStr = "";
+        if (this->depthFormat == DepthFormat::REVERSED)
+            depthFormatStr = "Depth: reversed-Z float\n";
+        else if (this->depthFormat == DepthFormat::UNORM24)
+            depthFormatStr = "Depth: 24-bit unorm, 8-bit stencil\n";
+        std::string traversalStr = "";
+        if (this->traversal == Traversal::SCANLINE)
+            traversalStr = "Traversal: scanline\n";
+        else if (this->traversal == Traversal::TILED)
+            traversalStr = "Traversal: tiled\n";
+        else if (this->traversal == Traversal::AUTO)
+            traversalStr = "Traversal: auto\n";
+
+        std::string occlusionStr = "";
+        if (this->occlusion.enabled)
+            occlusionStr = "Occlusion: occluders above " + ToStr(this->occlusion.occluderArea) + " of the screen\n";
+
+        std::string ssaoStr = "";
+        if (this->ssao.enabled)
+            ssaoStr = "SSAO: radius " + ToStr(this->ssao.radius) + ", " + ToStr(this->ssao.samples) + " samples, intensity " +
+                ToStr(this->ssao.intensity) + "\n";
+
+        std::string profileStr = "";
+        if (this->profile.enabled)
+            profileStr = "Profile: on" + (this->profile.trace.empty() ? std::string() : ", trace " + this->profile.trace) + "\n";
+
         return "Type: " + typeStr + "\n" +
             "Anti-alias: " + AAStr + ((this->AAConfig == AntiAliasConfig::NONE) ? "" : " with spp " + ToStr(this->AASpp)) + "\n" +
             "Resolution: " + ToStr(this->width) + "x" + ToStr(this->height) + "\n" +
             "Model: " + this->modelName + "\n" +
+            "Materials: " + ToStr(this->GetMaterials().size()) + " (" + ToStr(this->GetTextures().size()) + " textures)\n" +
             "Output: " + this->outputName + "\n" + 
             ((camera.width == 0) ? "<no camera specified>" : (this->camera.Info())) + "\n" +
-            transformStr + lightStr;
+            transformStr + lightStr + animationStr + lodStr + cullingStr + sortStr + earlyZStr + progressiveStr + transparencyStr + fixedPointStr + traversalStr + depthFormatStr + occlusionStr + ssaoStr + profileStr;
     }
 
     inline const TestType GetType() const { return this->type; }
@@ -115,6 +276,10 @@ public:
     inline const uint32_t GetWidth() const { return this->width; }
     inline const uint32_t GetHeight() const { return this->height; }
     inline const std::string GetOutputName() const { return this->outputName; }
+    inline const std::string& GetModelName() const { return this->modelName; }
+    inline const bool GetUseMeshCache() const { return this->useMeshCache; }
+    inline void SetOutputName(std::string name) { this->outputName = name; }
+    inline void SetResolution(uint32_t width, uint32_t height) { this->width = width; this->height = height; }
 
     inline const glm::vec3 GetTestInput() const 
     {
@@ -132,12 +297,32 @@ public:
     }
 
     inline const Camera& GetCamera() const { return this->camera; }
-    inline const std::vector<tinyobj::shape_t>& GetShapes() const { return this->shapes; }
+    inline const std::vector<tinyobj::shape_t>& GetShapes() const { return this->GetMesh().shapes; }
     inline const std::vector<MeshTransform>& GetTransforms() const { return this->transforms; }
+    inline const std::vector<InstanceGroup>& GetInstances() const { return this->instances; }
     inline const std::vector<Light>& GetLights() const { return this->lights; }
     inline const float GetSpecularExponent() const { return this->specularExponent; }
     inline const Color GetAmbientColor() const { return this->ambientColor; }
-    inline const tinyobj::attrib_t& GetAttribs() const { return this->attribs; }
+    inline const AnimationConfig& GetAnimation() const { return this->animation; }
+    inline const ProfileConfig& GetProfile() const { return this->profile; }
+    inline const tinyobj::attrib_t& GetAttribs() const { return this->GetMesh().attribs; }
+    inline const std::vector<Material>& GetMaterials() const { return this->GetMesh().materials; }
+    inline const std::vector<Texture>& GetTextures() const { return this->GetMesh().textures; }
+    inline const std::vector<ShapeVertices>& GetShapeVertices() const { return this->GetMesh().shapeVertices; }
+    inline const std::vector<ShapeBounds>& GetShapeBounds() const { return this->GetMesh().shapeBounds; }
+    inline const bool GetCulling() const { return this->culling; }
+    inline const LodConfig& GetLod() const { return this->lod; }
+    inline const OcclusionConfig& GetOcclusion() const { return this->occlusion; }
+    inline const AmbientOcclusionConfig& GetAmbientOcclusion() const { return this->ssao; }
+    inline const bool GetSort() const { return this->sort; }
+    inline const bool GetEarlyZ() const { return this->earlyZ; }
+    inline const bool GetProgressive() const { return this->progressive; }
+    inline const bool GetTransparency() const { return this->transparency; }
+    inline const bool GetFixedPoint() const { return this->fixedPoint; }
+    inline const Traversal GetTraversal() const { return this->traversal; }
+    inline const DepthFormat GetDepthFormat() const { return this->depthFormat; }
+    inline const std::vector<std::vector<LodLevel>>& GetLods() const { return this->GetMesh().lods; }
+    inline const std::shared_ptr<const MeshData>& GetMeshData() const { return this->mesh; }
 
 private:
     // configs
@@ -148,6 +333,18 @@ private:
     uint32_t height;
     std::string modelName;
     std::string outputName;
+    bool useMeshCache = true;
+    bool culling = false;                           // skip draws outside the frustum; see Frustum for the clip space
+    bool sort = false;                              // draw front to back instead of in file order
+    bool earlyZ = false;                            // resolve all depth before shading the visible pixels only
+    bool progressive = false;                       // also write 1/8, 1/4 and 1/2 resolution previews first
+    bool transparency = false;                      // blend materials with dissolve < 1 instead of drawing them opaque
+    bool fixedPoint = false;                        // snapped, top-left rule coverage instead of bounding box loops
+    Traversal traversal = Traversal::BOX;
+    DepthFormat depthFormat = DepthFormat::FLOAT;
+    LodConfig lod;
+    OcclusionConfig occlusion;
+    AmbientOcclusionConfig ssao;
     AntiAliasConfig AAConfig = AntiAliasConfig::NONE;
     uint32_t AASpp = 0;
 
@@ -156,17 +353,32 @@ private:
 
     Camera camera;
 
-    tinyobj::attrib_t attribs;
-    std::vector<tinyobj::shape_t> shapes;
+    std::shared_ptr<const MeshData> mesh;
+    std::vector<GeneratorConfig> generators;       // procedural shapes used instead of the obj when not empty
     std::vector<MeshTransform> transforms;
+    std::vector<InstanceGroup> instances;
 
     std::vector<Light> lights;
     float specularExponent;
     Color ambientColor;
 
+    AnimationConfig animation;
+    ProfileConfig profile;
+    Camera baseCamera;                              // state from the top level config, used where keyframes
+    std::vector<MeshTransform> baseTransforms;      //   do not specify a camera or transform
+
     // helpers
     bool LoadYaml();
-    bool LoadObj();
+    bool LoadObj(AssetCache* cache);
+    const MeshData& GetMesh() const;
+    static std::shared_ptr<MeshData> ParseObj(const std::string& filename, const std::string& searchPath);
+    static void LoadTextures(MeshData& mesh, const std::string& searchPath);
+    static void IndexShapes(MeshData& mesh);          // fills shapeVertices and shapeBounds
+    static void IndexShape(const tinyobj::attrib_t& attribs, const tinyobj::shape_t& shape, std::vector<uint32_t>& slot,
+        ShapeVertices& vertices, ShapeBounds& bounds);
+    static void BuildLods(MeshData& mesh, const LodConfig& lod);
+    static void IndexLods(MeshData& mesh);
+    bool ResolveInstances();
 };
 
 #endif
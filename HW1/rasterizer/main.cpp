@@ -1,9 +1,52 @@
+#include <cctype>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 
+#include "batch.hpp"
 #include "renderer.hpp"
 
+// Parse a decimal thread count that fits 32 bits; anything else is rejected rather than thrown
+bool ParseCount(const char* text, uint32_t& count)
+{
+    uint64_t value = 0;
+    for (const char* c = text; *c; ++c)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(*c)))
+            return false;
+        value = value * 10 + static_cast<uint64_t>(*c - '0');
+        if (value > UINT32_MAX)
+            return false;
+    }
+    count = static_cast<uint32_t>(value);
+    return *text != '\0';
+}
+
 int main(int argc, char** argv)
 {
+    // Batch mode: Rasterizer --batch <config directory | list file> [--jobs N]
+    if (argc > 2 && std::strcmp(argv[1], "--batch") == 0)
+    {
+        uint32_t jobs = 0;
+        if (argc > 4 && std::strcmp(argv[3], "--jobs") == 0 && !ParseCount(argv[4], jobs))
+        {
+            std::cerr << "Usage: " << argv[0] << " --batch <config directory | list file> [--jobs N]" << std::endl;
+            return 1;
+        }
+
+        try
+        {
+            BatchRenderer batch(jobs);
+            return batch.Run(BatchRenderer::CollectConfigs(argv[2])) == 0 ? 0 : 1;
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Batch rendering failed..." << std::endl;
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     std::string configName = "config.yaml";
     if (argc > 1)
         configName = std::string(argv[1]) + ".yaml";
@@ -18,4 +61,4 @@ int main(int argc, char** argv)
         std::cerr << "Rendering process failed..." << std::endl; 
         std::cerr << e.what() << std::endl;
     }
-}
+}
\ No newline at end of file
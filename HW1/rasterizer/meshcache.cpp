@@ -0,0 +1,472 @@
+#include "meshcache.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../thirdparty/tinyobj/tiny_obj_fwd.h"
+
+namespace
+{
+    constexpr char MAGIC[4] = { 'R', 'M', 'S', 'H' };
+    constexpr char LOD_MAGIC[4] = { 'R', 'L', 'O', 'D' };
+    constexpr uint32_t VERSION = 3;
+    constexpr size_t HASH_SPAN = 64 * 1024;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t realSize;          // sizeof(tinyobj::real_t)
+        uint32_t reserved;
+        uint64_t objSize;
+        int64_t objMtime;
+        uint64_t objHash;
+    };
+
+    struct SourceStamp
+    {
+        uint64_t size;
+        int64_t mtime;
+        uint64_t hash;
+
+        inline bool operator!= (const SourceStamp& other) const
+        {
+            return this->size != other.size || this->mtime != other.mtime || this->hash != other.hash;
+        }
+    };
+
+    inline uint64_t Fnv1a(const char* data, size_t size, uint64_t hash)
+    {
+        for (size_t i = 0; i != size; ++i)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Hash the first, middle and last 64 KiB of the file; together with size and mtime this catches
+    //   edits without reading a multi-gigabyte .obj on every startup
+    bool Stamp(const std::string& filename, SourceStamp& stamp)
+    {
+        std::error_code error;
+        stamp.size = std::filesystem::file_size(filename, error);
+        if (error)
+            return false;
+        stamp.mtime = static_cast<int64_t>(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+        if (error)
+            return false;
+
+        std::ifstream ifs(filename, std::ios::binary);
+        if (!ifs)
+            return false;
+        std::vector<char> buffer(HASH_SPAN);
+        uint64_t hash = 14695981039346656037ull;
+        uint64_t offsets[3] = { 0, stamp.size / 2, stamp.size > HASH_SPAN ? stamp.size - HASH_SPAN : 0 };
+        for (uint64_t offset : offsets)
+        {
+            ifs.seekg(static_cast<std::streamoff>(offset));
+            ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            hash = Fnv1a(buffer.data(), static_cast<size_t>(ifs.gcount()), hash);
+            ifs.clear();
+        }
+        stamp.hash = hash;
+        return true;
+    }
+
+    // Stamp of a .mtl library, all zero if it does not exist (a real stamp never has a zero hash)
+    SourceStamp LibraryStamp(const std::string& filename)
+    {
+        SourceStamp stamp{};
+        if (!Stamp(filename, stamp))
+            stamp = SourceStamp{};
+        return stamp;
+    }
+
+    // Read-only view of a whole file, memory-mapped where the platform allows it
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string& filename)
+        {
+#if defined(_WIN32)
+            std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+            if (!ifs)
+                return;
+            this->fallback.resize(static_cast<size_t>(ifs.tellg()));
+            ifs.seekg(0);
+            ifs.read(this->fallback.data(), static_cast<std::streamsize>(this->fallback.size()));
+            this->data = this->fallback.data();
+            this->size = this->fallback.size();
+#else
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED)
+                {
+                    this->data = static_cast<const char*>(mapped);
+                    this->size = static_cast<size_t>(st.st_size);
+                }
+            }
+            close(fd);
+#endif
+        }
+
+        ~MappedFile()
+        {
+#if !defined(_WIN32)
+            if (this->data)
+                munmap(const_cast<char*>(this->data), this->size);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator= (const MappedFile&) = delete;
+
+        const char* data = nullptr;
+        size_t size = 0;
+
+    private:
+#if defined(_WIN32)
+        std::vector<char> fallback;
+#endif
+    };
+
+    // Bounds-checked sequential reader over the mapped cache
+    class Reader
+    {
+    public:
+        Reader(const char* data, size_t size) : cursor(data), end(data + size) {  }
+
+        template<typename T>
+        bool Read(T& value)
+        {
+            if (static_cast<size_t>(this->end - this->cursor) < sizeof(T))
+                return false;
+            std::memcpy(&value, this->cursor, sizeof(T));
+            this->cursor += sizeof(T);
+            return true;
+        }
+
+        template<typename T>
+        bool Read(std::vector<T>& values)
+        {
+            uint64_t count;
+            if (!this->Read(count) || count > static_cast<uint64_t>(this->end - this->cursor) / sizeof(T))
+                return false;
+            values.resize(static_cast<size_t>(count));
+            std::memcpy(values.data(), this->cursor, static_cast<size_t>(count) * sizeof(T));
+            this->cursor += count * sizeof(T);
+            return true;
+        }
+
+        bool Read(std::string& value)
+        {
+            std::vector<char> chars;
+            if (!this->Read(chars))
+                return false;
+            value.assign(chars.begin(), chars.end());
+            return true;
+        }
+
+    private:
+        const char* cursor;
+        const char* end;
+    };
+
+    class Writer
+    {
+    public:
+        Writer(std::ofstream& ofs) : ofs(ofs) {  }
+
+        template<typename T>
+        void Write(const T& value)
+        {
+            this->ofs.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template<typename T>
+        void Write(const std::vector<T>& values)
+        {
+            this->Write(static_cast<uint64_t>(values.size()));
+            this->ofs.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+        }
+
+        void Write(const std::string& value)
+        {
+            this->Write(std::vector<char>(value.begin(), value.end()));
+        }
+
+    private:
+        std::ofstream& ofs;
+    };
+
+    inline std::string CacheFilename(const std::string& objFilename)
+    {
+        return objFilename + ".meshcache";
+    }
+
+    inline std::string LodCacheFilename(const std::string& objFilename)
+    {
+        return objFilename + ".lodcache";
+    }
+
+    Header MakeHeader(const char (&magic)[4], const SourceStamp& stamp)
+    {
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = VERSION;
+        header.realSize = sizeof(tinyobj::real_t);
+        header.objSize = stamp.size;
+        header.objMtime = stamp.mtime;
+        header.objHash = stamp.hash;
+        return header;
+    }
+
+    bool ReadHeader(Reader& reader, const char (&magic)[4], const SourceStamp& stamp)
+    {
+        Header header;
+        return reader.Read(header) &&
+            std::memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+            header.version == VERSION &&
+            header.realSize == sizeof(tinyobj::real_t) &&
+            header.objSize == stamp.size &&
+            header.objMtime == stamp.mtime &&
+            header.objHash == stamp.hash;
+    }
+
+    // Temporary file to write `filename` through, unique across processes and across the threads of this one
+    std::string TempFilename(const std::string& filename)
+    {
+        static std::atomic<uint64_t> counter{ 0 };
+#if defined(_WIN32)
+        int64_t pid = _getpid();
+#else
+        int64_t pid = getpid();
+#endif
+        return filename + ".tmp" + std::to_string(pid) + "-" + std::to_string(counter++);
+    }
+
+    // Close `ofs`, writing out what it still buffers, and move the temporary file over `filename` if every
+    //   write succeeded. The temporary file is removed otherwise
+    bool Commit(std::ofstream& ofs, const std::string& tempFilename, const std::string& filename)
+    {
+        ofs.close();
+        std::error_code error;
+        if (ofs)
+            std::filesystem::rename(tempFilename, filename, error);
+        if (!ofs || error)
+        {
+            std::error_code removeError;
+            std::filesystem::remove(tempFilename, removeError);
+            return false;
+        }
+        return true;
+    }
+}
+
+std::shared_ptr<MeshData> ReadMeshCache(const std::string& objFilename, const std::string& searchPath)
+{
+    SourceStamp stamp;
+    if (!Stamp(objFilename, stamp))
+        return nullptr;
+
+    MappedFile file(CacheFilename(objFilename));
+    if (!file.data)
+        return nullptr;
+
+    Reader reader(file.data, file.size);
+    if (!ReadHeader(reader, MAGIC, stamp))
+        return nullptr;
+
+    // materials come from the .mtl files, so the cache is stale if any of them changed
+    auto mesh = std::make_shared<MeshData>();
+    uint64_t libraryCount = 0;
+    if (!reader.Read(libraryCount))
+        return nullptr;
+    for (uint64_t l = 0; l != libraryCount; ++l)
+    {
+        std::string library;
+        SourceStamp libraryStamp;
+        if (!reader.Read(library) || !reader.Read(libraryStamp) || LibraryStamp(searchPath + library) != libraryStamp)
+            return nullptr;
+        mesh->materialLibraries.push_back(std::move(library));
+    }
+
+    tinyobj::attrib_t& attribs = mesh->attribs;
+    bool ok = reader.Read(attribs.vertices) && reader.Read(attribs.normals) &&
+        reader.Read(attribs.texcoords) && reader.Read(attribs.colors);
+
+    uint64_t shapeCount = 0;
+    ok = ok && reader.Read(shapeCount);
+    for (uint64_t s = 0; ok && s != shapeCount; ++s)
+    {
+        tinyobj::shape_t shape;
+        ok = reader.Read(shape.name) && reader.Read(shape.mesh.indices) &&
+            reader.Read(shape.mesh.num_face_vertices) && reader.Read(shape.mesh.material_ids) &&
+            reader.Read(shape.mesh.smoothing_group_ids);
+        mesh->shapes.push_back(std::move(shape));
+    }
+
+    uint64_t materialCount = 0;
+    ok = ok && reader.Read(materialCount);
+    for (uint64_t m = 0; ok && m != materialCount; ++m)
+    {
+        std::string name, texname;
+        glm::vec3 diffuse;
+        float dissolve;
+        ok = reader.Read(name) && reader.Read(diffuse) && reader.Read(dissolve) && reader.Read(texname);
+        mesh->materials.emplace_back(name, diffuse, dissolve, texname);
+    }
+
+    if (!ok)
+    {
+        std::cout << "[WARNING] ignoring truncated mesh cache " << CacheFilename(objFilename) << std::endl;
+        return nullptr;
+    }
+    return mesh;
+}
+
+bool WriteMeshCache(const std::string& objFilename, const std::string& searchPath, const MeshData& mesh)
+{
+    SourceStamp stamp;
+    if (!Stamp(objFilename, stamp))
+        return false;
+
+    std::string filename = CacheFilename(objFilename);
+    std::string tempFilename = TempFilename(filename);
+    std::ofstream ofs(tempFilename, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+        return false;
+
+    Writer writer(ofs);
+    writer.Write(MakeHeader(MAGIC, stamp));
+
+    writer.Write(static_cast<uint64_t>(mesh.materialLibraries.size()));
+    for (const std::string& library : mesh.materialLibraries)
+    {
+        writer.Write(library);
+        writer.Write(LibraryStamp(searchPath + library));
+    }
+
+    const tinyobj::attrib_t& attribs = mesh.attribs;
+    writer.Write(attribs.vertices);
+    writer.Write(attribs.normals);
+    writer.Write(attribs.texcoords);
+    writer.Write(attribs.colors);
+
+    writer.Write(static_cast<uint64_t>(mesh.shapes.size()));
+    for (const tinyobj::shape_t& shape : mesh.shapes)
+    {
+        writer.Write(shape.name);
+        writer.Write(shape.mesh.indices);
+        writer.Write(shape.mesh.num_face_vertices);
+        writer.Write(shape.mesh.material_ids);
+        writer.Write(shape.mesh.smoothing_group_ids);
+    }
+
+    writer.Write(static_cast<uint64_t>(mesh.materials.size()));
+    for (const Material& material : mesh.materials)
+    {
+        writer.Write(material.name);
+        writer.Write(material.diffuse);
+        writer.Write(material.dissolve);
+        writer.Write(material.diffuseTexname);
+    }
+
+    return Commit(ofs, tempFilename, filename);
+}
+
+bool ReadLodCache(const std::string& objFilename, const LodConfig& lod, MeshData& mesh)
+{
+    SourceStamp stamp;
+    if (!Stamp(objFilename, stamp))
+        return false;
+
+    MappedFile file(LodCacheFilename(objFilename));
+    if (!file.data)
+        return false;
+
+    Reader reader(file.data, file.size);
+    uint32_t levels;
+    float ratio;
+    uint64_t shapeCount;
+    if (!ReadHeader(reader, LOD_MAGIC, stamp) || !reader.Read(levels) || !reader.Read(ratio) ||
+        levels != lod.levels || ratio != lod.ratio || !reader.Read(shapeCount) || shapeCount != mesh.shapes.size())
+        return false;
+
+    std::vector<std::vector<LodLevel>> lods(mesh.shapes.size());
+    bool ok = true;
+    for (size_t s = 0; ok && s != lods.size(); ++s)
+    {
+        uint64_t levelCount = 0;
+        ok = reader.Read(levelCount) && levelCount <= lod.levels;
+        for (uint64_t l = 0; ok && l != levelCount; ++l)
+        {
+            LodLevel level;
+            level.shape.name = mesh.shapes[s].name;
+            ok = reader.Read(level.error) && reader.Read(level.shape.mesh.indices) &&
+                reader.Read(level.shape.mesh.material_ids);
+            level.shape.mesh.num_face_vertices.assign(level.shape.mesh.indices.size() / 3, 3);
+            level.shape.mesh.smoothing_group_ids.assign(level.shape.mesh.indices.size() / 3, 0);
+            lods[s].push_back(std::move(level));
+        }
+    }
+
+    if (!ok)
+    {
+        std::cout << "[WARNING] ignoring truncated LOD cache " << LodCacheFilename(objFilename) << std::endl;
+        return false;
+    }
+    mesh.lods = std::move(lods);
+    return true;
+}
+
+bool WriteLodCache(const std::string& objFilename, const LodConfig& lod, const MeshData& mesh)
+{
+    SourceStamp stamp;
+    if (!Stamp(objFilename, stamp))
+        return false;
+
+    std::string filename = LodCacheFilename(objFilename);
+    std::string tempFilename = TempFilename(filename);
+    std::ofstream ofs(tempFilename, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+        return false;
+
+    Writer writer(ofs);
+    writer.Write(MakeHeader(LOD_MAGIC, stamp));
+    writer.Write(lod.levels);
+    writer.Write(lod.ratio);
+    writer.Write(static_cast<uint64_t>(mesh.lods.size()));
+    for (const std::vector<LodLevel>& levels : mesh.lods)
+    {
+        writer.Write(static_cast<uint64_t>(levels.size()));
+        for (const LodLevel& level : levels)
+        {
+            writer.Write(level.error);
+            writer.Write(level.shape.mesh.indices);
+            writer.Write(level.shape.mesh.material_ids);
+        }
+    }
+
+    return Commit(ofs, tempFilename, filename);
+}
@@ -0,0 +1,32 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <memory>
+#include <string>
+
+#include "loader.hpp"
+
+// Binary copy of a parsed OBJ, stored as `<model>.obj.meshcache` next to the source file.
+//   The header records the size, modification time and a sampled content hash of the .obj, and the cache lists
+//   the same stamp for every .mtl the OBJ names (or that it was missing); a cache that does not match all of
+//   them (or was written by another format version) is ignored.
+//   Textures are not part of the cache, only the material table referencing them.
+//   The cache is mapped to skip parsing, but its arrays are still copied out of the mapping, one memcpy each,
+//   into the vectors of the mesh.
+
+// Map the cache of `objFilename`, whose .mtl files are looked up in `searchPath`, and rebuild the mesh from it.
+//   Returns nullptr if there is no valid cache
+std::shared_ptr<MeshData> ReadMeshCache(const std::string& objFilename, const std::string& searchPath);
+
+// Write the cache of `objFilename` for `mesh`. The file is written under a temporary name of its own and renamed
+//   once every write succeeded, so concurrent readers and writers never observe a partial cache. Returns false
+//   if the cache could not be written
+bool WriteMeshCache(const std::string& objFilename, const std::string& searchPath, const MeshData& mesh);
+
+// The LOD chain of a mesh is kept in `<model>.obj.lodcache`, with the same header as the mesh cache and the
+//   LodConfig it was built with. Only the simplified faces and their errors are stored; the chain is read
+//   into `mesh.lods` (vertices and bounds left empty) if it matches both the .obj and `lod`
+bool ReadLodCache(const std::string& objFilename, const LodConfig& lod, MeshData& mesh);
+bool WriteLodCache(const std::string& objFilename, const LodConfig& lod, const MeshData& mesh);
+
+#endif
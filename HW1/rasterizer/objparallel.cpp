@@ -0,0 +1,396 @@
+#include "objparallel.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <thread>
+
+namespace
+{
+    // Face-vertex indices are resolved in two steps: a chunk does not know how many vertices precede it,
+    //   so relative (negative) OBJ indices are stored biased by RELATIVE and rebased during the merge
+    constexpr int64_t ABSENT = INT64_MIN;
+    constexpr int64_t RELATIVE = int64_t(1) << 40;
+    constexpr int32_t INHERIT_MATERIAL = -2;
+
+    struct Segment
+    {
+        bool startsShape;       // opened by an `o`/`g` line inside the chunk
+        std::string name;
+        size_t firstFace;
+    };
+
+    struct Chunk
+    {
+        std::vector<tinyobj::real_t> vertices, normals, texcoords, colors;
+        std::vector<int64_t> indices;                   // (v, vt, vn) per face-vertex
+        std::vector<unsigned int> faceVertexCounts;
+        std::vector<int32_t> faceMaterials;             // into materialNames, or INHERIT_MATERIAL
+        std::vector<std::string> materialNames;
+        std::vector<Segment> segments;
+        std::vector<std::string> mtllibs;
+        int32_t lastMaterial = INHERIT_MATERIAL;
+
+        std::vector<tinyobj::index_t> resolved;
+        std::vector<int> resolvedMaterials;
+    };
+
+    inline bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+    inline bool IsLineEnd(char c) { return c == '\n' || c == '\r' || c == '\0'; }
+
+    inline const char* SkipSpace(const char* p) { while (IsSpace(*p)) ++p; return p; }
+
+    // True if the line at p starts with `keyword` followed by whitespace
+    inline bool IsKeyword(const char* p, const char* end, const std::string& keyword)
+    {
+        return static_cast<size_t>(end - p) > keyword.size() && keyword.compare(0, keyword.size(), p, keyword.size()) == 0 &&
+            IsSpace(p[keyword.size()]);
+    }
+
+    inline std::string RestOfLine(const char* p)
+    {
+        p = SkipSpace(p);
+        const char* end = p;
+        while (!IsLineEnd(*end))
+            ++end;
+        while (end > p && IsSpace(end[-1]))
+            --end;
+        return std::string(p, end);
+    }
+
+    // Parse up to `count` reals; returns how many were found on the line
+    inline size_t ParseReals(const char*& p, tinyobj::real_t* out, size_t count)
+    {
+        size_t n = 0;
+        for (; n != count; ++n)
+        {
+            p = SkipSpace(p);
+            if (IsLineEnd(*p))
+                break;
+            char* next;
+            out[n] = static_cast<tinyobj::real_t>(std::strtod(p, &next));
+            if (next == p)
+                break;
+            p = next;
+        }
+        return n;
+    }
+
+    inline int64_t EncodeIndex(long raw, size_t localCount)
+    {
+        if (raw > 0)
+            return raw - 1;
+        if (raw < 0)
+            return static_cast<int64_t>(localCount) + raw - RELATIVE;
+        return ABSENT;
+    }
+
+    inline int DecodeIndex(int64_t value, size_t base)
+    {
+        if (value == ABSENT)
+            return -1;
+        if (value < 0)
+            return static_cast<int>(static_cast<int64_t>(base) + value + RELATIVE);
+        return static_cast<int>(value);
+    }
+
+    void ParseChunk(const char* begin, const char* end, const tinyobj::ObjReaderConfig& config, Chunk& chunk)
+    {
+        chunk.segments.push_back({ false, "", 0 });
+        int32_t material = INHERIT_MATERIAL;
+        std::vector<int64_t> polygon;
+
+        for (const char* line = begin; line < end; )
+        {
+            const char* p = SkipSpace(line);
+
+            if (p[0] == 'v' && IsSpace(p[1]))
+            {
+                tinyobj::real_t values[6] = { 0, 0, 0, 1, 1, 1 };
+                ++p;
+                ParseReals(p, values, 6);
+                chunk.vertices.insert(chunk.vertices.end(), values, values + 3);
+                if (config.vertex_color)
+                    chunk.colors.insert(chunk.colors.end(), values + 3, values + 6);
+            }
+            else if (p[0] == 'v' && p[1] == 'n' && IsSpace(p[2]))
+            {
+                tinyobj::real_t values[3] = { 0, 0, 0 };
+                p += 2;
+                ParseReals(p, values, 3);
+                chunk.normals.insert(chunk.normals.end(), values, values + 3);
+            }
+            else if (p[0] == 'v' && p[1] == 't' && IsSpace(p[2]))
+            {
+                tinyobj::real_t values[2] = { 0, 0 };
+                p += 2;
+                ParseReals(p, values, 2);
+                chunk.texcoords.insert(chunk.texcoords.end(), values, values + 2);
+            }
+            else if (p[0] == 'f' && IsSpace(p[1]))
+            {
+                ++p;
+                polygon.clear();
+                size_t vCount = chunk.vertices.size() / 3, vtCount = chunk.texcoords.size() / 2, vnCount = chunk.normals.size() / 3;
+                while (true)
+                {
+                    p = SkipSpace(p);
+                    if (IsLineEnd(*p))
+                        break;
+                    char* next;
+                    long v = std::strtol(p, &next, 10), vt = 0, vn = 0;
+                    if (next == p)
+                        break;
+                    p = next;
+                    if (*p == '/')
+                    {
+                        ++p;
+                        if (*p != '/')
+                        {
+                            vt = std::strtol(p, &next, 10);
+                            p = next;
+                        }
+                        if (*p == '/')
+                        {
+                            ++p;
+                            vn = std::strtol(p, &next, 10);
+                            p = next;
+                        }
+                    }
+                    polygon.push_back(EncodeIndex(v, vCount));
+                    polygon.push_back(EncodeIndex(vt, vtCount));
+                    polygon.push_back(EncodeIndex(vn, vnCount));
+                }
+
+                size_t n = polygon.size() / 3;
+                if (n >= 3 && config.triangulate)
+                {
+                    for (size_t i = 1; i + 1 < n; ++i)
+                    {
+                        for (size_t corner : { size_t(0), i, i + 1 })
+                            chunk.indices.insert(chunk.indices.end(), polygon.begin() + 3 * corner, polygon.begin() + 3 * corner + 3);
+                        chunk.faceVertexCounts.push_back(3);
+                        chunk.faceMaterials.push_back(material);
+                    }
+                }
+                else if (n >= 3)
+                {
+                    chunk.indices.insert(chunk.indices.end(), polygon.begin(), polygon.end());
+                    chunk.faceVertexCounts.push_back(static_cast<unsigned int>(n));
+                    chunk.faceMaterials.push_back(material);
+                }
+            }
+            else if ((p[0] == 'o' || p[0] == 'g') && (IsSpace(p[1]) || IsLineEnd(p[1])))
+            {
+                std::string name = RestOfLine(p + 1);
+                Segment& current = chunk.segments.back();
+                // a shape header directly following another one replaces it, as no face belongs to the first
+                if (current.startsShape && current.firstFace == chunk.faceVertexCounts.size())
+                    current.name = name;
+                else
+                    chunk.segments.push_back({ true, name, chunk.faceVertexCounts.size() });
+            }
+            else if (IsKeyword(p, end, "usemtl"))
+            {
+                std::string name = RestOfLine(p + 6);
+                auto it = std::find(chunk.materialNames.begin(), chunk.materialNames.end(), name);
+                material = static_cast<int32_t>(it - chunk.materialNames.begin());
+                if (it == chunk.materialNames.end())
+                    chunk.materialNames.push_back(name);
+                chunk.lastMaterial = material;
+            }
+            else if (IsKeyword(p, end, "mtllib"))
+            {
+                std::string names = RestOfLine(p + 6);
+                size_t start = 0;
+                while (start < names.size())
+                {
+                    size_t stop = names.find_first_of(" \t", start);
+                    if (stop == std::string::npos)
+                        stop = names.size();
+                    if (stop > start)
+                        chunk.mtllibs.push_back(names.substr(start, stop - start));
+                    start = stop + 1;
+                }
+            }
+
+            while (line < end && *line != '\n')
+                ++line;
+            ++line;
+        }
+    }
+}
+
+bool ParallelObjReader::ParseFromFile(const std::string& filename, const tinyobj::ObjReaderConfig& config, uint32_t threads)
+{
+    this->valid = false;
+    this->attrib = tinyobj::attrib_t();
+    this->shapes.clear();
+    this->materials.clear();
+    this->materialLibraries.clear();
+    this->warning.clear();
+    this->error.clear();
+
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if (!ifs)
+    {
+        this->error = "Cannot open file [" + filename + "]\n";
+        return false;
+    }
+    std::string buffer(static_cast<size_t>(ifs.tellg()), '\0');
+    ifs.seekg(0);
+    ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    // Split into line-aligned chunks of at least 1 MiB each
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkCount = std::clamp<size_t>(buffer.size() >> 20, 1, threads);
+    std::vector<size_t> bounds{ 0 };
+    for (size_t c = 1; c < chunkCount; ++c)
+    {
+        size_t pos = std::max(bounds.back(), buffer.size() * c / chunkCount);
+        pos = buffer.find('\n', pos);
+        if (pos == std::string::npos)
+            break;
+        bounds.push_back(pos + 1);
+    }
+    bounds.push_back(buffer.size());
+    chunkCount = bounds.size() - 1;
+
+    std::vector<Chunk> chunks(chunkCount);
+    auto parallelFor = [&](auto body)
+    {
+        std::vector<std::thread> workers;
+        for (size_t c = 1; c < chunkCount; ++c)
+            workers.emplace_back(body, c);
+        body(0);
+        for (std::thread& worker : workers)
+            worker.join();
+    };
+    const char* data = buffer.c_str();
+    parallelFor([&](size_t c) { ParseChunk(data + bounds[c], data + bounds[c + 1], config, chunks[c]); });
+
+    // Materials, in the order their libraries are referenced
+    std::map<std::string, int> materialMap;
+    std::string searchPath = config.mtl_search_path;
+    if (searchPath.empty())
+    {
+        size_t slash = filename.find_last_of("/\\");
+        searchPath = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+    }
+    else if (searchPath.back() != '/' && searchPath.back() != '\\')
+        searchPath += '/';
+
+    for (const Chunk& chunk : chunks)
+        for (const std::string& lib : chunk.mtllibs)
+        {
+            if (std::find(this->materialLibraries.begin(), this->materialLibraries.end(), lib) !=
+                this->materialLibraries.end())
+                continue;
+            this->materialLibraries.push_back(lib);
+            std::ifstream mtl(searchPath + lib);
+            if (!mtl)
+            {
+                this->warning += "Material file [ " + searchPath + lib + " ] not found.\n";
+                continue;
+            }
+            std::string mtlWarning, mtlError;
+            tinyobj::LoadMtl(&materialMap, &this->materials, &mtl, &mtlWarning, &mtlError);
+            this->warning += mtlWarning;
+            this->warning += mtlError;
+        }
+
+    // Offsets of each chunk in the merged attribute arrays, and the material active when it starts
+    std::vector<size_t> vBase(chunkCount + 1, 0), vtBase(chunkCount + 1, 0), vnBase(chunkCount + 1, 0);
+    std::vector<int> startMaterial(chunkCount, -1);
+    int material = -1;
+    for (size_t c = 0; c != chunkCount; ++c)
+    {
+        vBase[c + 1] = vBase[c] + chunks[c].vertices.size() / 3;
+        vtBase[c + 1] = vtBase[c] + chunks[c].texcoords.size() / 2;
+        vnBase[c + 1] = vnBase[c] + chunks[c].normals.size() / 3;
+        startMaterial[c] = material;
+        if (chunks[c].lastMaterial != INHERIT_MATERIAL)
+        {
+            auto it = materialMap.find(chunks[c].materialNames[chunks[c].lastMaterial]);
+            material = it == materialMap.end() ? -1 : it->second;
+        }
+    }
+
+    parallelFor([&](size_t c)
+    {
+        Chunk& chunk = chunks[c];
+        chunk.resolved.resize(chunk.indices.size() / 3);
+        for (size_t i = 0; i != chunk.resolved.size(); ++i)
+        {
+            chunk.resolved[i].vertex_index = DecodeIndex(chunk.indices[3 * i + 0], vBase[c]);
+            chunk.resolved[i].texcoord_index = DecodeIndex(chunk.indices[3 * i + 1], vtBase[c]);
+            chunk.resolved[i].normal_index = DecodeIndex(chunk.indices[3 * i + 2], vnBase[c]);
+        }
+
+        std::vector<int> localToGlobal(chunk.materialNames.size(), -1);
+        for (size_t m = 0; m != chunk.materialNames.size(); ++m)
+        {
+            auto it = materialMap.find(chunk.materialNames[m]);
+            if (it != materialMap.end())
+                localToGlobal[m] = it->second;
+        }
+        chunk.resolvedMaterials.resize(chunk.faceMaterials.size());
+        for (size_t f = 0; f != chunk.faceMaterials.size(); ++f)
+            chunk.resolvedMaterials[f] = chunk.faceMaterials[f] == INHERIT_MATERIAL ? startMaterial[c] : localToGlobal[chunk.faceMaterials[f]];
+    });
+
+    for (size_t c = 0; c != chunkCount; ++c)
+    {
+        const Chunk& chunk = chunks[c];
+        for (const std::string& name : chunk.materialNames)
+            if (materialMap.find(name) == materialMap.end())
+                this->warning += "material [ '" + name + "' ] not found in .mtl\n";
+
+        auto& attrib = this->attrib;
+        attrib.vertices.insert(attrib.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        attrib.normals.insert(attrib.normals.end(), chunk.normals.begin(), chunk.normals.end());
+        attrib.texcoords.insert(attrib.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+        attrib.colors.insert(attrib.colors.end(), chunk.colors.begin(), chunk.colors.end());
+    }
+
+    // Stitch segments into shapes; a chunk's leading segment continues the shape open at its start
+    tinyobj::shape_t current;
+    auto flush = [&]()
+    {
+        if (!current.mesh.num_face_vertices.empty())
+            this->shapes.push_back(std::move(current));
+        current = tinyobj::shape_t();
+    };
+    for (size_t c = 0; c != chunkCount; ++c)
+    {
+        const Chunk& chunk = chunks[c];
+        size_t indexOffset = 0;
+        for (size_t s = 0; s != chunk.segments.size(); ++s)
+        {
+            const Segment& segment = chunk.segments[s];
+            size_t lastFace = s + 1 < chunk.segments.size() ? chunk.segments[s + 1].firstFace : chunk.faceVertexCounts.size();
+            if (segment.startsShape)
+            {
+                flush();
+                current.name = segment.name;
+            }
+
+            size_t indexCount = 0;
+            for (size_t f = segment.firstFace; f != lastFace; ++f)
+                indexCount += chunk.faceVertexCounts[f];
+
+            tinyobj::mesh_t& mesh = current.mesh;
+            mesh.indices.insert(mesh.indices.end(), chunk.resolved.begin() + indexOffset, chunk.resolved.begin() + indexOffset + indexCount);
+            mesh.num_face_vertices.insert(mesh.num_face_vertices.end(), chunk.faceVertexCounts.begin() + segment.firstFace, chunk.faceVertexCounts.begin() + lastFace);
+            mesh.material_ids.insert(mesh.material_ids.end(), chunk.resolvedMaterials.begin() + segment.firstFace, chunk.resolvedMaterials.begin() + lastFace);
+            mesh.smoothing_group_ids.resize(mesh.num_face_vertices.size(), 0);
+            indexOffset += indexCount;
+        }
+    }
+    flush();
+
+    this->valid = true;
+    return true;
+}
@@ -0,0 +1,102 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+OcclusionBuffer::OcclusionBuffer(const glm::mat4& screen, const Camera& camera, uint32_t width, uint32_t height,
+    float clearDepth) :
+    clearDepth(clearDepth),
+    width(width),
+    height(height),
+    cellsX(std::min(width, MAX_WIDTH)),
+    cellsY(std::min(height, MAX_HEIGHT))
+{
+    this->nearDepth = DepthAt(screen, camera, camera.nearClip);
+    this->farDepth = DepthAt(screen, camera, camera.farClip);
+}
+
+void OcclusionBuffer::Build(const DepthBuffer& ZBuffer)
+{
+    // start from the nearest possible depth; the reduction keeps whichever pixel is farther
+    this->cells.assign(static_cast<size_t>(this->cellsX) * this->cellsY, this->nearDepth);
+    if (ZBuffer.GetWidth() != this->width || ZBuffer.GetHeight() != this->height)
+    {
+        std::fill(this->cells.begin(), this->cells.end(), std::numeric_limits<float>::quiet_NaN());
+        return;
+    }
+
+    for (uint32_t y = 0; y != this->height; ++y)
+    {
+        float* row = &this->cells[static_cast<size_t>(y * this->cellsY / this->height) * this->cellsX];
+        for (uint32_t x = 0; x != this->width; ++x)
+        {
+            float depth = ZBuffer.Get(x, y).value();
+            float& cell = row[x * this->cellsX / this->width];
+            if (depth == this->clearDepth || std::isnan(depth))
+                cell = std::numeric_limits<float>::quiet_NaN();
+            else if (this->IsCloser(cell, depth))
+                cell = depth;
+        }
+    }
+}
+
+bool OcclusionBuffer::Project(const glm::mat4& screen, const Bounds& bounds, glm::vec2& lo, glm::vec2& hi,
+    float& nearest) const
+{
+    if (bounds.Empty())
+        return false;
+
+    lo = glm::vec2(INFINITY);
+    hi = glm::vec2(-INFINITY);
+    for (size_t i = 0; i != 8; ++i)
+    {
+        glm::vec4 p = screen * glm::vec4(bounds.Corner(i), 1.f);
+        if (!(p.w > 0.f))
+            return false;
+        p /= p.w;
+        lo = glm::min(lo, glm::vec2(p));
+        hi = glm::max(hi, glm::vec2(p));
+        // depth is monotonic along view rays, so the nearest point of the box projects from one of its corners
+        if (i == 0 || this->IsCloser(p.z, nearest))
+            nearest = p.z;
+    }
+    return true;
+}
+
+bool OcclusionBuffer::Occluded(const glm::mat4& screen, const Bounds& bounds) const
+{
+    if (this->cells.empty() || !this->Valid())
+        return false;
+
+    glm::vec2 lo, hi;
+    float nearest;
+    if (!this->Project(screen, bounds, lo, hi, nearest))
+        return false;
+    if (hi.x < 0.f || hi.y < 0.f || lo.x >= static_cast<float>(this->width) || lo.y >= static_cast<float>(this->height))
+        return false;
+
+    // the raster passes visit the pixels between the truncated vertex coordinates
+    uint32_t x0 = static_cast<uint32_t>(std::max(lo.x, 0.f));
+    uint32_t y0 = static_cast<uint32_t>(std::max(lo.y, 0.f));
+    uint32_t x1 = static_cast<uint32_t>(std::min(hi.x, static_cast<float>(this->width - 1)));
+    uint32_t y1 = static_cast<uint32_t>(std::min(hi.y, static_cast<float>(this->height - 1)));
+
+    for (uint32_t cy = y0 * this->cellsY / this->height; cy <= y1 * this->cellsY / this->height; ++cy)
+        for (uint32_t cx = x0 * this->cellsX / this->width; cx <= x1 * this->cellsX / this->width; ++cx)
+            if (!this->IsCloser(this->cells[static_cast<size_t>(cy) * this->cellsX + cx], nearest))
+                return false;
+    return true;
+}
+
+float OcclusionBuffer::ScreenArea(const glm::mat4& screen, const Bounds& bounds) const
+{
+    glm::vec2 lo, hi;
+    float nearest;
+    if (!this->Project(screen, bounds, lo, hi, nearest))
+        return 0.f;
+
+    glm::vec2 size = glm::clamp(hi, glm::vec2(0.f), glm::vec2(this->width, this->height)) -
+        glm::clamp(lo, glm::vec2(0.f), glm::vec2(this->width, this->height));
+    return std::max(size.x, 0.f) * std::max(size.y, 0.f);
+}
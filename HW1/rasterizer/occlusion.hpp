@@ -0,0 +1,53 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <cstdint>
+#include <vector>
+
+#include "depthbuffer.hpp"
+#include "entities.hpp"
+
+#include "../thirdparty/glm/glm.hpp"
+
+// Coarse depth of the occluders drawn so far, for conservative occlusion tests of bounding boxes.
+//   Every cell keeps the farthest depth of the pixels it covers, so a box whose nearest point lies
+//   behind all cells under its screen rectangle cannot pass the depth test anywhere
+
+class OcclusionBuffer
+{
+public:
+    static constexpr uint32_t MAX_WIDTH = 256;
+    static constexpr uint32_t MAX_HEIGHT = 128;
+
+    // `screen = screenspace * projection * view`. The depths it gives to points at the near and far clip
+    //   distances decide which direction is closer, whatever depth convention the projection follows.
+    //   Pixels still holding `clearDepth` have not been drawn and never occlude
+    OcclusionBuffer(const glm::mat4& screen, const Camera& camera, uint32_t width, uint32_t height, float clearDepth);
+
+    // Reduce `ZBuffer`, of the size given to the constructor, to at most MAX_WIDTH x MAX_HEIGHT cells
+    void Build(const DepthBuffer& ZBuffer);
+
+    // True if the box under `screen = screenspace * projection * view * model` is behind every cell it overlaps.
+    //   Boxes reaching behind the camera are never occluded
+    bool Occluded(const glm::mat4& screen, const Bounds& bounds) const;
+
+    // Area in pixels of the screen rectangle of the box, clamped to the viewport; 0 for boxes reaching behind the camera
+    float ScreenArea(const glm::mat4& screen, const Bounds& bounds) const;
+
+    inline bool Valid() const { return this->nearDepth < this->farDepth || this->nearDepth > this->farDepth; }
+    inline bool IsCloser(float a, float b) const { return this->nearDepth > this->farDepth ? a > b : a < b; }
+
+private:
+    // Screen rectangle and nearest depth of the box; false if a corner is behind the camera
+    bool Project(const glm::mat4& screen, const Bounds& bounds, glm::vec2& lo, glm::vec2& hi, float& nearest) const;
+
+    float nearDepth;
+    float farDepth;
+    float clearDepth;
+
+    uint32_t width, height;                     // of the depth buffer
+    uint32_t cellsX, cellsY;
+    std::vector<float> cells;                   // NaN where a pixel of the cell is not covered, which compares as never closer
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <thread>
+
+namespace
+{
+    const char* CounterName(size_t counter)
+    {
+        static const char* names[] = { "triangles", "pixels tested", "pixels passed", "pixels shaded", "pixels visible",
+            "draws culled", "chunks culled", "draws occluded",
+            "fragments" };
+        return names[counter];
+    }
+
+    inline double Microseconds(Profiler::Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+}
+
+Profiler::Profiler(bool enabled) : enabled(enabled), origin(Clock::now()), counters()
+{   }
+
+void Profiler::Record(const char* name, Clock::time_point start, Clock::time_point end)
+{
+    uint32_t thread = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xffff);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->events.push_back({ name, start, end, thread });
+}
+
+void Profiler::PrintSummary(std::ostream& out) const
+{
+    std::map<std::string, std::pair<double, size_t>> stages;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (const Event& event : this->events)
+        {
+            auto& stage = stages[event.name];
+            stage.first += Microseconds(event.end - event.start);
+            ++stage.second;
+        }
+    }
+
+    std::string sephead = "=====================Profile======================\n";
+    std::string sep = "==================================================\n";
+    out << sephead;
+    for (const auto& [name, stage] : stages)
+        out << "| " << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(12) << stage.first / 1000.0 << " ms  (" << stage.second << " spans)\n";
+    for (size_t c = 0; c != this->counters.size(); ++c)
+        out << "| " << std::left << std::setw(16) << CounterName(c) << std::right << std::setw(12) << this->counters[c] << "\n";
+
+    uint64_t visible = this->Get(Counter::PIXELS_VISIBLE);
+    if (visible > 0)
+        out << "| overdraw         " << std::setprecision(3) << std::setw(11)
+            << static_cast<double>(this->Get(Counter::PIXELS_PASSED)) / static_cast<double>(visible) << "x depth, "
+            << static_cast<double>(this->Get(Counter::PIXELS_SHADED)) / static_cast<double>(visible) << "x shading\n";
+    out << sep;
+}
+
+bool Profiler::WriteTrace(const std::string& filename) const
+{
+    std::ofstream ofs(filename);
+    if (!ofs)
+        return false;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // spans recorded before the profiler existed (e.g. config loading) move the origin back
+    Clock::time_point origin = this->origin;
+    for (const Event& event : this->events)
+        origin = std::min(origin, event.start);
+
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    Clock::time_point last = origin;
+    for (const Event& event : this->events)
+    {
+        ofs << std::fixed << std::setprecision(3)
+            << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << Microseconds(event.start - origin)
+            << ",\"dur\":" << Microseconds(event.end - event.start) << "},\n";
+        last = std::max(last, event.end);
+    }
+    ofs << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":" << Microseconds(last - origin) << ",\"args\":{";
+    for (size_t c = 0; c != this->counters.size(); ++c)
+        ofs << (c ? "," : "") << "\"" << CounterName(c) << "\":" << this->counters[c];
+    ofs << "}}\n]}\n";
+    return static_cast<bool>(ofs);
+}
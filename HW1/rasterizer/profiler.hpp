@@ -0,0 +1,90 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per-render timers and counters for the rasterizer pipeline. A disabled profiler costs one branch
+//   per scope/counter; an enabled one keeps every scope as an event for the Chrome trace
+//   (chrome://tracing or https://ui.perfetto.dev)
+
+enum class Counter
+{
+    TRIANGLES,          // triangles submitted to a raster pass
+    PIXELS_TESTED,      // pixels visited by the depth pass
+    PIXELS_PASSED,      // pixels whose depth was updated
+    PIXELS_SHADED,      // calls to ShadeAtPixel
+    PIXELS_VISIBLE,     // pixels covered in the final depth buffer
+    DRAWS_CULLED,       // draws (shape instances) outside the view frustum
+    CHUNKS_CULLED,      // chunks of faces outside the view frustum, inside partially visible draws
+    DRAWS_OCCLUDED,     // draws behind the occluders drawn first
+    FRAGMENTS,          // translucent fragments stored for order-independent transparency
+    COUNT
+};
+
+class Profiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Times the enclosing scope under `name`
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, const char* name) :
+            profiler(profiler), name(name), start(profiler.enabled ? Clock::now() : Clock::time_point()) {  }
+        ~Scope() { if (this->profiler.enabled) this->profiler.Record(this->name, this->start, Clock::now()); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator= (const Scope&) = delete;
+
+    private:
+        Profiler& profiler;
+        const char* name;
+        Clock::time_point start;
+    };
+
+    Profiler(bool enabled = false);
+
+    inline bool Enabled() const { return this->enabled; }
+    inline void SetEnabled(bool enabled) { this->enabled = enabled; }
+
+    inline void Add(Counter counter, uint64_t value)
+    {
+        if (this->enabled)
+            this->counters[static_cast<size_t>(counter)] += value;
+    }
+    inline uint64_t Get(Counter counter) const { return this->counters[static_cast<size_t>(counter)]; }
+
+    // Record a finished span; safe to call from any thread
+    void Record(const char* name, Clock::time_point start, Clock::time_point end);
+
+    // Per-stage totals, pixel counters and overdraw (depth writes per visible pixel)
+    void PrintSummary(std::ostream& out) const;
+
+    // Write all spans and the final counters in Chrome trace event format
+    bool WriteTrace(const std::string& filename) const;
+
+private:
+    struct Event
+    {
+        const char* name;
+        Clock::time_point start;
+        Clock::time_point end;
+        uint32_t thread;
+    };
+
+    bool enabled;
+    Clock::time_point origin;
+    std::array<uint64_t, static_cast<size_t>(Counter::COUNT)> counters;
+
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "radixsort.hpp"
+
+#include <array>
+#include <cstddef>
+
+void RadixSortIndices(const std::vector<uint16_t>& keys, std::vector<uint32_t>& order)
+{
+    const size_t count = keys.size();
+    std::array<std::array<uint32_t, 256>, 2> histograms{};
+    for (uint16_t key : keys)
+    {
+        ++histograms[0][key & 0xff];
+        ++histograms[1][key >> 8];
+    }
+
+    std::vector<uint32_t> buffer(count);
+    order.resize(count);
+    for (size_t i = 0; i != count; ++i)
+        order[i] = static_cast<uint32_t>(i);
+
+    for (uint32_t pass = 0; pass != 2; ++pass)
+    {
+        // a digit shared by every key leaves the order unchanged
+        std::array<uint32_t, 256>& histogram = histograms[pass];
+        uint32_t shift = 8 * pass;
+        if (count == 0 || histogram[(keys[0] >> shift) & 0xff] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t& bucket : histogram)
+        {
+            uint32_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+        for (uint32_t index : order)
+            buffer[histogram[(keys[index] >> shift) & 0xff]++] = index;
+        order.swap(buffer);
+    }
+}
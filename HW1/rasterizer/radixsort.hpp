@@ -0,0 +1,13 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <cstdint>
+#include <vector>
+
+// Stable LSD radix sort on 16-bit keys, two passes of 8-bit digits. Used to order draws and
+//   chunks of faces by quantized view depth, where a comparison sort would dominate for many small items
+
+// Fill `order` with the indices of `keys` sorted by ascending key; equal keys keep their relative order
+void RadixSortIndices(const std::vector<uint16_t>& keys, std::vector<uint32_t>& order);
+
+#endif
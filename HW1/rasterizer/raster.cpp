@@ -0,0 +1,304 @@
+#include "raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Vertices are kept within +-2^22 pixels, so that products of two edge terms stay well inside int64
+    constexpr float MAX_COORDINATE = 4194304.f;
+
+    inline int64_t FloorDiv(int64_t a, int64_t b)
+    {
+        int64_t q = a / b;
+        return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+    }
+
+    // Below this many pixels, a box is walked whole
+    constexpr float SMALL_BOX = 64.f;
+    // Triangles covering less of their box than this are walked by spans
+    constexpr float SLIVER_COVERAGE = 0.25f;
+    // Float spans and tile tests are widened by this many pixels against rounding
+    constexpr float MARGIN = 1.f / 64.f;
+}
+
+Traversal ChooseTraversal(uint32_t boxWidth, uint32_t boxHeight, float area)
+{
+    float box = static_cast<float>(boxWidth) * boxHeight;
+    if (box <= SMALL_BOX)
+        return Traversal::BOX;
+    if (area < SLIVER_COVERAGE * box)
+        return Traversal::SCANLINE;
+    if (boxWidth >= 2 * TRAVERSAL_TILE && boxHeight >= 2 * TRAVERSAL_TILE)
+        return Traversal::TILED;
+    return Traversal::SCANLINE;
+}
+
+PixelRect ScreenRect(const glm::mat4& screen, const Bounds& bounds, uint32_t width, uint32_t height)
+{
+    PixelRect viewport;
+    if (width == 0 || height == 0 || bounds.Empty())
+        return viewport;
+    viewport = { 0, width - 1, 0, height - 1 };
+
+    glm::vec2 lo(INFINITY), hi(-INFINITY);
+    for (size_t i = 0; i != 8; ++i)
+    {
+        glm::vec4 p = screen * glm::vec4(bounds.Corner(i), 1.f);
+        // a box reaching behind the camera projects onto both sides of the screen
+        if (!(p.w > 0.f))
+            return viewport;
+        lo = glm::min(lo, glm::vec2(p) / p.w);
+        hi = glm::max(hi, glm::vec2(p) / p.w);
+    }
+    if (!(lo.x <= hi.x && lo.y <= hi.y))
+        return viewport;
+    if (hi.x + 1.f < 0.f || hi.y + 1.f < 0.f || lo.x - 1.f >= width || lo.y - 1.f >= height)
+        return PixelRect();
+
+    PixelRect rect;
+    rect.xmin = static_cast<uint32_t>(std::max(lo.x - 1.f, 0.f));
+    rect.ymin = static_cast<uint32_t>(std::max(lo.y - 1.f, 0.f));
+    rect.xmax = static_cast<uint32_t>(std::min(hi.x + 1.f, static_cast<float>(width - 1)));
+    rect.ymax = static_cast<uint32_t>(std::min(hi.y + 1.f, static_cast<float>(height - 1)));
+    return rect;
+}
+
+bool FixedTriangle::Snappable(const Triangle& trig)
+{
+    for (size_t i = 0; i != 3; ++i)
+        if (!(std::abs(trig.pos[i].x) < MAX_COORDINATE && std::abs(trig.pos[i].y) < MAX_COORDINATE))
+            return false;
+    return true;
+}
+
+bool FixedTriangle::Setup(Triangle& trig, uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+        return false;
+
+    std::array<int64_t, 3> vx, vy;
+    for (size_t i = 0; i != 3; ++i)
+    {
+        glm::vec4& p = trig.pos[i];
+        if (!(std::abs(p.x) < MAX_COORDINATE && std::abs(p.y) < MAX_COORDINATE))
+            return false;
+        vx[i] = std::llround(p.x * SUBPIXEL);
+        vy[i] = std::llround(p.y * SUBPIXEL);
+        p.x = static_cast<float>(vx[i]) / SUBPIXEL;
+        p.y = static_cast<float>(vy[i]) / SUBPIXEL;
+    }
+
+    // orient the edges so that the inside is positive, whichever way the triangle winds
+    int64_t area = (vx[1] - vx[0]) * (vy[2] - vy[0]) - (vy[1] - vy[0]) * (vx[2] - vx[0]);
+    if (area == 0)
+        return false;
+    this->area = static_cast<float>(std::abs(area)) / (2 * SUBPIXEL * SUBPIXEL);
+    if (area < 0)
+    {
+        std::swap(vx[1], vx[2]);
+        std::swap(vy[1], vy[2]);
+    }
+
+    // the pixels holding the vertices, as in the bounding box loops, clipped to the viewport
+    int64_t xlo = std::max<int64_t>(FloorDiv(*std::min_element(vx.begin(), vx.end()), SUBPIXEL), 0);
+    int64_t xhi = std::min<int64_t>(FloorDiv(*std::max_element(vx.begin(), vx.end()), SUBPIXEL), width - 1);
+    int64_t ylo = std::max<int64_t>(FloorDiv(*std::min_element(vy.begin(), vy.end()), SUBPIXEL), 0);
+    int64_t yhi = std::min<int64_t>(FloorDiv(*std::max_element(vy.begin(), vy.end()), SUBPIXEL), height - 1);
+    if (xlo > xhi || ylo > yhi)
+        return false;
+    this->xmin = static_cast<uint32_t>(xlo);
+    this->xmax = static_cast<uint32_t>(xhi);
+    this->ymin = static_cast<uint32_t>(ylo);
+    this->ymax = static_cast<uint32_t>(yhi);
+
+    int64_t px = xlo * SUBPIXEL + SUBPIXEL / 2;
+    int64_t py = ylo * SUBPIXEL + SUBPIXEL / 2;
+    for (size_t i = 0; i != 3; ++i)
+    {
+        size_t j = (i + 1) % 3;
+        int64_t dx = vx[j] - vx[i];
+        int64_t dy = vy[j] - vy[i];
+
+        // E(p) = dx * (p.y - v.y) - dy * (p.x - v.x), positive inside
+        this->origin[i] = dx * (py - vy[i]) - dy * (px - vx[i]);
+        this->stepX[i] = -dy * SUBPIXEL;
+        this->stepY[i] = dx * SUBPIXEL;
+
+        // with the inside on the left of every edge, top edges run towards -x and left edges towards -y
+        bool topLeft = (dy == 0 && dx < 0) || dy < 0;
+        this->bias[i] = topLeft ? 0 : -1;
+        this->slack[i] = (SUBPIXEL / 2) * (std::abs(dx) + std::abs(dy));
+    }
+    return true;
+}
+
+bool FixedTriangle::Span(const std::array<int64_t, 3>& row, bool conservative, uint32_t& x0, uint32_t& x1) const
+{
+    const std::array<int64_t, 3>& offset = conservative ? this->slack : this->bias;
+    int64_t first = 0, last = static_cast<int64_t>(this->xmax) - this->xmin;
+    for (size_t i = 0; i != 3; ++i)
+    {
+        // solve value + k * step >= 0 for the pixel offset k
+        int64_t value = row[i] + offset[i];
+        int64_t step = this->stepX[i];
+        if (step > 0)
+            first = std::max(first, -FloorDiv(value, step));
+        else if (step < 0)
+            last = std::min(last, FloorDiv(value, -step));
+        else if (value < 0)
+            return false;
+    }
+    if (first > last)
+        return false;
+    x0 = this->xmin + static_cast<uint32_t>(first);
+    x1 = this->xmin + static_cast<uint32_t>(last);
+    return true;
+}
+
+bool FixedTriangle::Clip(const PixelRect& rect)
+{
+    uint32_t xmin = std::max(this->xmin, rect.xmin), xmax = std::min(this->xmax, rect.xmax);
+    uint32_t ymin = std::max(this->ymin, rect.ymin), ymax = std::min(this->ymax, rect.ymax);
+    if (xmin > xmax || ymin > ymax)
+        return false;
+    for (size_t i = 0; i != 3; ++i)
+        this->origin[i] += int64_t(xmin - this->xmin) * this->stepX[i] + int64_t(ymin - this->ymin) * this->stepY[i];
+    this->xmin = xmin;
+    this->xmax = xmax;
+    this->ymin = ymin;
+    this->ymax = ymax;
+    return true;
+}
+
+bool ScreenTriangle::Setup(const Triangle& trig, uint32_t width, uint32_t height)
+{
+    glm::vec2 lo(INFINITY), hi(-INFINITY);
+    for (size_t i = 0; i != 3; ++i)
+    {
+        const glm::vec4& p = trig.pos[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y))
+            return false;
+        this->v[i] = glm::vec2(p);
+        lo = glm::min(lo, this->v[i]);
+        hi = glm::max(hi, this->v[i]);
+    }
+    if (width == 0 || height == 0 || hi.x < 0.f || hi.y < 0.f || lo.x >= width || lo.y >= height)
+        return false;
+
+    this->xmin = static_cast<uint32_t>(std::max(lo.x, 0.f));
+    this->ymin = static_cast<uint32_t>(std::max(lo.y, 0.f));
+    this->xmax = static_cast<uint32_t>(std::min(hi.x, static_cast<float>(width - 1)));
+    this->ymax = static_cast<uint32_t>(std::min(hi.y, static_cast<float>(height - 1)));
+
+    glm::vec2 e1 = this->v[1] - this->v[0], e2 = this->v[2] - this->v[0];
+    this->area = std::abs(e1.x * e2.y - e1.y * e2.x) / 2.f;
+    return true;
+}
+
+bool ScreenTriangle::Span(uint32_t y, uint32_t& x0, uint32_t& x1) const
+{
+    // the part of the triangle within the row lies between its vertices in the row and the points where its
+    //   edges cross the top and bottom of the row
+    const float top = static_cast<float>(y), bottom = top + 1.f;
+    float lo = INFINITY, hi = -INFINITY;
+    for (size_t i = 0; i != 3; ++i)
+    {
+        const glm::vec2& a = this->v[i];
+        const glm::vec2& b = this->v[(i + 1) % 3];
+        if (a.y >= top && a.y <= bottom)
+        {
+            lo = std::min(lo, a.x);
+            hi = std::max(hi, a.x);
+        }
+        if (a.y == b.y)
+            continue;
+        for (float line : { top, bottom })
+            if (line >= std::min(a.y, b.y) && line <= std::max(a.y, b.y))
+            {
+                float x = a.x + (line - a.y) * (b.x - a.x) / (b.y - a.y);
+                lo = std::min(lo, x);
+                hi = std::max(hi, x);
+            }
+    }
+    lo -= MARGIN;
+    hi += MARGIN;
+    if (!(lo <= hi) || hi < this->xmin || lo >= this->xmax + 1.f)
+        return false;
+
+    x0 = lo <= this->xmin ? this->xmin : static_cast<uint32_t>(lo);
+    x1 = hi >= this->xmax ? this->xmax : static_cast<uint32_t>(hi);
+    return x0 <= x1;
+}
+
+bool ScreenTriangle::Touches(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const
+{
+    glm::vec2 e1 = this->v[1] - this->v[0], e2 = this->v[2] - this->v[0];
+    float orientation = e1.x * e2.y - e1.y * e2.x;
+    if (orientation == 0.f)
+        return true;
+    float inside = orientation > 0.f ? 1.f : -1.f;
+
+    const std::array<glm::vec2, 4> corners = {
+        glm::vec2(x0, y0), glm::vec2(x1 + 1.f, y0), glm::vec2(x0, y1 + 1.f), glm::vec2(x1 + 1.f, y1 + 1.f)
+    };
+    for (size_t i = 0; i != 3; ++i)
+    {
+        const glm::vec2& a = this->v[i];
+        glm::vec2 d = this->v[(i + 1) % 3] - a;
+        float farthest = -INFINITY;
+        for (const glm::vec2& c : corners)
+            farthest = std::max(farthest, (d.x * (c.y - a.y) - d.y * (c.x - a.x)) * inside);
+        // every corner is outside this edge
+        if (farthest < -MARGIN * (std::abs(d.x) + std::abs(d.y)))
+            return false;
+    }
+    return true;
+}
+
+bool ScreenTriangle::Clip(const PixelRect& rect)
+{
+    this->xmin = std::max(this->xmin, rect.xmin);
+    this->xmax = std::min(this->xmax, rect.xmax);
+    this->ymin = std::max(this->ymin, rect.ymin);
+    this->ymax = std::min(this->ymax, rect.ymax);
+    return this->xmin <= this->xmax && this->ymin <= this->ymax;
+}
+
+bool TriangleWalk::Setup(Triangle& trig, uint32_t width, uint32_t height, bool fixedPoint)
+{
+    // the pipeline does not clip against the near plane, so a triangle close to the camera may have a vertex
+    //   projected far off the grid; it is walked unsnapped rather than dropped
+    this->fixedPoint = fixedPoint && FixedTriangle::Snappable(trig);
+    if (this->fixedPoint)
+        return this->fixed.Setup(trig, width, height);
+    return this->screen.Setup(trig, width, height);
+}
+
+void TriangleSetup::Build(const Triangle& transformed, const glm::vec3& inverseW, const TriangleWalk& walk)
+{
+    std::array<glm::vec2, 3> p;
+    for (size_t i = 0; i != 3; ++i)
+        p[i] = glm::vec2(transformed.pos[i]);
+
+    // the edge function opposite each vertex, divided by the doubled area, is its barycentric coordinate
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+    this->depth = glm::vec3(0.f);
+    for (size_t i = 0; i != 3; ++i)
+    {
+        const glm::vec2& a = p[(i + 1) % 3];
+        const glm::vec2& b = p[(i + 2) % 3];
+        if (area == 0.f)
+            this->barycentric[i] = glm::vec3(0.f, 0.f, 1.f / 3.f);
+        else
+            this->barycentric[i] = glm::vec3(a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x) / area;
+        this->depth += transformed.pos[i].z * this->barycentric[i];
+    }
+
+    this->inverseW = inverseW;
+    this->xmin = walk.XMin();
+    this->xmax = walk.XMax();
+    this->ymin = walk.YMin();
+    this->ymax = walk.YMax();
+    this->materialId = transformed.materialId;
+}
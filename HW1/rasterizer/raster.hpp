@@ -0,0 +1,317 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "entities.hpp"
+
+// Pixel traversal shared by the raster passes. Vertices are snapped to a 24.8 fixed-point grid and coverage
+//   is decided by integer edge functions at pixel centers with the top-left fill rule: a pixel center on an
+//   edge shared by two triangles belongs to exactly one of them, and stepping from pixel to pixel is exact
+
+// How a raster pass walks the pixels of a triangle
+enum class Traversal
+{
+    BOX,        // every pixel of the bounding box
+    SCANLINE,   // the span of each row, solved from the edges
+    TILED,      // 8x8 tiles, skipping those outside an edge
+    AUTO        // chosen per triangle by ChooseTraversal
+};
+
+constexpr uint32_t TRAVERSAL_TILE = 8;
+
+// A rectangle of pixels, bounds included as for the triangle bounds. Empty if xmin > xmax
+struct PixelRect
+{
+    uint32_t xmin = UINT32_MAX, xmax = 0, ymin = UINT32_MAX, ymax = 0;
+
+    inline bool Empty() const { return this->xmin > this->xmax || this->ymin > this->ymax; }
+    inline bool Intersects(const PixelRect& other) const
+    {
+        return !this->Empty() && !other.Empty() && this->xmin <= other.xmax && other.xmin <= this->xmax &&
+            this->ymin <= other.ymax && other.ymin <= this->ymax;
+    }
+    inline void Extend(const PixelRect& other)
+    {
+        if (other.Empty())
+            return;
+        this->xmin = std::min(this->xmin, other.xmin);
+        this->xmax = std::max(this->xmax, other.xmax);
+        this->ymin = std::min(this->ymin, other.ymin);
+        this->ymax = std::max(this->ymax, other.ymax);
+    }
+};
+
+// The pixels a raster pass may visit for triangles inside `bounds` under `screen = screenspace * projection * view
+//   * model`, with a pixel of margin for rounding, clipped to a `width` x `height` viewport. The whole viewport if
+//   the box reaches behind the camera
+PixelRect ScreenRect(const glm::mat4& screen, const Bounds& bounds, uint32_t width, uint32_t height);
+
+// Tiny boxes are walked whole since they need no setup. Triangles covering little of their box, such as long
+//   diagonal slivers, are walked by spans, and large ones by tiles. `area` is in pixels
+Traversal ChooseTraversal(uint32_t boxWidth, uint32_t boxHeight, float area);
+
+struct FixedTriangle
+{
+    static constexpr int32_t SUBPIXEL_BITS = 8;
+    static constexpr int32_t SUBPIXEL = 1 << SUBPIXEL_BITS;
+
+    uint32_t xmin, xmax, ymin, ymax;    // pixel bounds, clipped to the viewport
+    std::array<int64_t, 3> origin;      // edge functions at the center of pixel (xmin, ymin)
+    std::array<int64_t, 3> stepX;       // change of the edge functions from one pixel to the next
+    std::array<int64_t, 3> stepY;
+    std::array<int64_t, 3> bias;        // -1 on edges that are not top-left, so that their own centers are excluded
+    std::array<int64_t, 3> slack;       // edge value of the pixel corner farthest inside, relative to the center
+    float area;                         // in pixels
+
+    // Whether every vertex of `trig` lies within the +-2^22 pixels that the grid holds
+    static bool Snappable(const Triangle& trig);
+
+    // Snap the screen-space x/y of `trig` to the grid (the snapped coordinates are written back, so the per-pixel
+    //   functions see the triangle that is traversed) and set up its edges. Returns false if the triangle is
+    //   degenerate, not Snappable, or covers no pixel of a `width` x `height` viewport
+    bool Setup(Triangle& trig, uint32_t width, uint32_t height);
+
+    inline bool Inside(const std::array<int64_t, 3>& edge) const
+    {
+        return edge[0] + this->bias[0] >= 0 && edge[1] + this->bias[1] >= 0 && edge[2] + this->bias[2] >= 0;
+    }
+    // The pixel square touches the triangle; used when the per-pixel function takes several samples
+    inline bool Touches(const std::array<int64_t, 3>& edge) const
+    {
+        return edge[0] + this->slack[0] >= 0 && edge[1] + this->slack[1] >= 0 && edge[2] + this->slack[2] >= 0;
+    }
+
+    // The first and last pixel of a row passing the test of Inside, or Touches if `conservative`, given the edge
+    //   values `row` at its pixel xmin. Returns false if there is none
+    bool Span(const std::array<int64_t, 3>& row, bool conservative, uint32_t& x0, uint32_t& x1) const;
+
+    // Restrict the bounds to `rect`, moving the edge functions to the new first pixel. Returns false if nothing is left
+    bool Clip(const PixelRect& rect);
+};
+
+// Call `visit(x, y)` for the pixels of `triangle`, row by row: those whose center is covered, or with `conservative`
+//   those the triangle touches at all. Returns the number of pixels visited
+template<typename F>
+uint64_t ForEachCoveredPixel(const FixedTriangle& triangle, bool conservative, Traversal traversal, F&& visit)
+{
+    if (traversal == Traversal::AUTO)
+        traversal = ChooseTraversal(triangle.xmax - triangle.xmin + 1, triangle.ymax - triangle.ymin + 1, triangle.area);
+
+    uint64_t visited = 0;
+    if (traversal == Traversal::SCANLINE)
+    {
+        // the span is exact, so its pixels need no test
+        std::array<int64_t, 3> row = triangle.origin;
+        for (uint32_t y = triangle.ymin; y <= triangle.ymax; ++y)
+        {
+            uint32_t x0, x1;
+            if (triangle.Span(row, conservative, x0, x1))
+            {
+                for (uint32_t x = x0; x <= x1; ++x)
+                    visit(x, y);
+                visited += x1 - x0 + 1;
+            }
+            for (size_t i = 0; i != 3; ++i)
+                row[i] += triangle.stepY[i];
+        }
+        return visited;
+    }
+
+    if (traversal == Traversal::TILED)
+    {
+        // the edges are linear, so their extremes over a tile are at its corner pixels: a tile is skipped if one
+        //   edge fails at all of them, and taken whole if every edge passes at all of them
+        const std::array<int64_t, 3>& offset = conservative ? triangle.slack : triangle.bias;
+        for (uint32_t ty = triangle.ymin; ty <= triangle.ymax; ty += TRAVERSAL_TILE)
+            for (uint32_t tx = triangle.xmin; tx <= triangle.xmax; tx += TRAVERSAL_TILE)
+            {
+                uint32_t tw = std::min(TRAVERSAL_TILE, triangle.xmax - tx + 1);
+                uint32_t th = std::min(TRAVERSAL_TILE, triangle.ymax - ty + 1);
+                std::array<int64_t, 3> corner;
+                bool outside = false, inside = true;
+                for (size_t i = 0; i != 3; ++i)
+                {
+                    corner[i] = triangle.origin[i] + offset[i] + int64_t(tx - triangle.xmin) * triangle.stepX[i] +
+                        int64_t(ty - triangle.ymin) * triangle.stepY[i];
+                    int64_t acrossX = int64_t(tw - 1) * triangle.stepX[i];
+                    int64_t acrossY = int64_t(th - 1) * triangle.stepY[i];
+                    if (corner[i] + std::max<int64_t>(acrossX, 0) + std::max<int64_t>(acrossY, 0) < 0)
+                        outside = true;
+                    if (corner[i] + std::min<int64_t>(acrossX, 0) + std::min<int64_t>(acrossY, 0) < 0)
+                        inside = false;
+                }
+                if (outside)
+                    continue;
+
+                for (uint32_t y = ty; y != ty + th; ++y)
+                {
+                    std::array<int64_t, 3> edge = corner;
+                    for (uint32_t x = tx; x != tx + tw; ++x)
+                    {
+                        if (inside || (edge[0] >= 0 && edge[1] >= 0 && edge[2] >= 0))
+                        {
+                            visit(x, y);
+                            ++visited;
+                        }
+                        for (size_t i = 0; i != 3; ++i)
+                            edge[i] += triangle.stepX[i];
+                    }
+                    for (size_t i = 0; i != 3; ++i)
+                        corner[i] += triangle.stepY[i];
+                }
+            }
+        return visited;
+    }
+
+    std::array<int64_t, 3> row = triangle.origin;
+    for (uint32_t y = triangle.ymin; y <= triangle.ymax; ++y)
+    {
+        std::array<int64_t, 3> edge = row;
+        for (uint32_t x = triangle.xmin; x <= triangle.xmax; ++x)
+        {
+            if (conservative ? triangle.Touches(edge) : triangle.Inside(edge))
+            {
+                visit(x, y);
+                ++visited;
+            }
+            for (size_t i = 0; i != 3; ++i)
+                edge[i] += triangle.stepX[i];
+        }
+        for (size_t i = 0; i != 3; ++i)
+            row[i] += triangle.stepY[i];
+    }
+    return visited;
+}
+
+// The unsnapped triangle walked by default. Its pixels are those between the truncated vertex coordinates, and
+//   the traversals only skip pixels whose closed square misses the triangle, so no pixel the per-pixel functions
+//   could cover is lost, wherever in the pixel they sample
+struct ScreenTriangle
+{
+    uint32_t xmin, xmax, ymin, ymax;    // pixel bounds, clipped to the viewport
+    std::array<glm::vec2, 3> v;
+    float area;                         // in pixels
+
+    // Returns false if a vertex is not finite or the bounds miss the viewport
+    bool Setup(const Triangle& trig, uint32_t width, uint32_t height);
+
+    // The pixels of row `y` that touch the triangle, within the bounds. Returns false if there are none
+    bool Span(uint32_t y, uint32_t& x0, uint32_t& x1) const;
+    // Whether the pixels from (x0, y0) to (x1, y1) may touch the triangle
+    bool Touches(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+
+    // Restrict the bounds to `rect`. Returns false if nothing is left
+    bool Clip(const PixelRect& rect);
+};
+
+// Call `visit(x, y)` for the pixels of `triangle`; the bounding box is walked column by column. Returns the number
+//   of pixels visited
+template<typename F>
+uint64_t ForEachBoxPixel(const ScreenTriangle& triangle, Traversal traversal, F&& visit)
+{
+    if (traversal == Traversal::AUTO)
+        traversal = ChooseTraversal(triangle.xmax - triangle.xmin + 1, triangle.ymax - triangle.ymin + 1, triangle.area);
+
+    uint64_t visited = 0;
+    if (traversal == Traversal::SCANLINE)
+    {
+        for (uint32_t y = triangle.ymin; y <= triangle.ymax; ++y)
+        {
+            uint32_t x0, x1;
+            if (!triangle.Span(y, x0, x1))
+                continue;
+            for (uint32_t x = x0; x <= x1; ++x)
+                visit(x, y);
+            visited += x1 - x0 + 1;
+        }
+        return visited;
+    }
+
+    if (traversal == Traversal::TILED)
+    {
+        for (uint32_t ty = triangle.ymin; ty <= triangle.ymax; ty += TRAVERSAL_TILE)
+            for (uint32_t tx = triangle.xmin; tx <= triangle.xmax; tx += TRAVERSAL_TILE)
+            {
+                uint32_t tx1 = std::min(tx + TRAVERSAL_TILE - 1, triangle.xmax);
+                uint32_t ty1 = std::min(ty + TRAVERSAL_TILE - 1, triangle.ymax);
+                if (!triangle.Touches(tx, ty, tx1, ty1))
+                    continue;
+                for (uint32_t y = ty; y <= ty1; ++y)
+                    for (uint32_t x = tx; x <= tx1; ++x)
+                        visit(x, y);
+                visited += uint64_t(tx1 - tx + 1) * (ty1 - ty + 1);
+            }
+        return visited;
+    }
+
+    for (uint32_t x = triangle.xmin; x <= triangle.xmax; ++x)
+        for (uint32_t y = triangle.ymin; y <= triangle.ymax; ++y)
+            visit(x, y);
+    return uint64_t(triangle.xmax - triangle.xmin + 1) * (triangle.ymax - triangle.ymin + 1);
+}
+
+// The traversal of one triangle, snapped or not depending on the `fixedPoint` config
+struct TriangleWalk
+{
+    bool fixedPoint = false;            // whether this triangle is snapped, see Setup
+    FixedTriangle fixed;
+    ScreenTriangle screen;
+
+    // Snap `trig` if `fixedPoint`, see FixedTriangle::Setup; a triangle that is not Snappable is walked as without
+    //   `fixedPoint`. Returns false if the triangle covers no pixel
+    bool Setup(Triangle& trig, uint32_t width, uint32_t height, bool fixedPoint);
+    // Visit only the pixels within `rect`. Returns false if the triangle has none there
+    inline bool Clip(const PixelRect& rect) { return this->fixedPoint ? this->fixed.Clip(rect) : this->screen.Clip(rect); }
+
+    inline uint32_t XMin() const { return this->fixedPoint ? this->fixed.xmin : this->screen.xmin; }
+    inline uint32_t XMax() const { return this->fixedPoint ? this->fixed.xmax : this->screen.xmax; }
+    inline uint32_t YMin() const { return this->fixedPoint ? this->fixed.ymin : this->screen.ymin; }
+    inline uint32_t YMax() const { return this->fixedPoint ? this->fixed.ymax : this->screen.ymax; }
+
+    template<typename F>
+    uint64_t Visit(bool conservative, Traversal traversal, F&& visit) const
+    {
+        if (this->fixedPoint)
+            return ForEachCoveredPixel(this->fixed, conservative, traversal, visit);
+        return ForEachBoxPixel(this->screen, traversal, visit);
+    }
+};
+
+// The per-triangle constants of the per-pixel functions, computed once by the raster passes instead of at every
+//   pixel. Each is a plane over the screen: evaluated at (x, y) as a dot product with (x, y, 1)
+struct TriangleSetup
+{
+    std::array<glm::vec3, 3> barycentric;   // the barycentric coordinate of each vertex
+    glm::vec3 depth;                        // screen-space z
+    glm::vec3 inverseW;                     // 1 / clip-space w of each vertex, for perspective correction
+    uint32_t xmin, xmax, ymin, ymax;        // the pixels the raster pass visits
+    int32_t materialId;
+
+    // Set up the planes of the screen-space triangle `transformed`. A degenerate triangle gets constant
+    //   barycentric coordinates of 1/3
+    void Build(const Triangle& transformed, const glm::vec3& inverseW, const TriangleWalk& walk);
+
+    inline glm::vec3 Barycentric(glm::vec2 p) const
+    {
+        glm::vec3 q(p, 1.f);
+        return glm::vec3(glm::dot(this->barycentric[0], q), glm::dot(this->barycentric[1], q),
+            glm::dot(this->barycentric[2], q));
+    }
+    inline float Depth(glm::vec2 p) const { return glm::dot(this->depth, glm::vec3(p, 1.f)); }
+
+    // Barycentric weights at `p` for the attributes of the original triangle, so that they are interpolated
+    //   linearly in space rather than on the screen
+    inline glm::vec3 PerspectiveBarycentric(glm::vec2 p) const
+    {
+        glm::vec3 weights = this->Barycentric(p) * this->inverseW;
+        float sum = weights.x + weights.y + weights.z;
+        return sum == 0.f ? glm::vec3(1.f, 0.f, 0.f) : weights / sum;
+    }
+};
+
+static_assert(sizeof(TriangleSetup) <= 128, "TriangleSetup should fit in two cache lines");
+
+#endif
@@ -1,8 +1,10 @@
 #include "rasterizer.hpp"
 
 #include "loader.hpp"
+#include "raster.hpp"
 #include <array>
 #include <cstdint>
+#include <optional>
 
 #include "../thirdparty/glm/gtx/quaternion.hpp"
 
@@ -17,13 +19,15 @@
 //  please add the files to the @includealso tag above. Otherwise, your files will
 //  not be included in grading. 
 
-Rasterizer::Rasterizer(Loader& loader) : 
+Rasterizer::Rasterizer(const Loader& loader) : 
     loader(loader),
     model(),
     view(glm::mat4(1.f)),  
     projection(glm::mat4(1.f)),  
     screenspace(glm::mat4(1.f)),
-    ZBuffer(loader.GetWidth(), loader.GetHeight(), loader.GetOutputName())
+    ZBuffer(loader.GetWidth(), loader.GetHeight(), loader.GetOutputName()),
+    TriangleIds(loader.GetWidth(), loader.GetHeight()),
+    profiler(loader.GetProfile().enabled)
 {   
     for (size_t i = 0; i != loader.GetHeight(); ++i)
         for (size_t j = 0; j != loader.GetWidth(); ++j)
@@ -32,91 +36,193 @@ Rasterizer::Rasterizer(Loader& loader) :
 
 void Rasterizer::DrawPrimitiveRaw(Image &image, Triangle trig, AntiAliasConfig config, uint32_t spp)
 {
-    uint32_t xmax = 0, xmin = UINT32_MAX;
-    uint32_t ymax = 0, ymin = UINT32_MAX;
-    const std::array<glm::vec4, 3>& vertices = trig.pos;
-
-    std::array<glm::vec3, 3> trimmedPos;
-    for (size_t ind = 0; ind != 3; ++ind)
+    // DrawPixel takes several samples under SSAA, so every pixel the triangle touches is visited
+    this->profiler.Add(Counter::TRIANGLES, 1);
+    TriangleSetup setup;
+    TriangleWalk walk;
+    if (!this->SetupTriangle(trig, trig, setup, walk))
+        return;
+    uint64_t tested = walk.Visit(config == AntiAliasConfig::SSAA, this->loader.GetTraversal(), [&](uint32_t x, uint32_t y)
     {
-        const glm::vec4& v = vertices[ind];
-        if (v.x > xmax)
-            xmax = v.x;
-        if (v.x < xmin)
-            xmin = v.x;
-        if (v.y > ymax)
-            ymax = v.y;
-        if (v.y < ymin)
-            ymin = v.y;
-        trimmedPos[ind] = glm::vec3(v.x, v.y, 0);
-    }
-    
-    for (uint32_t x = xmin; x <= xmax; ++x)
-        for (uint32_t y = ymin; y <= ymax; ++y)
-            this->DrawPixel(x, y, trig, config, spp, image, Color::White);
+        this->DrawPixel(x, y, trig, setup, config, spp, image, Color::White);
+    });
+    this->profiler.Add(Counter::PIXELS_TESTED, tested);
 }
 
 void Rasterizer::AddModel(MeshTransform transform)
 {
     glm::mat4 rotation = glm::toMat4(transform.rotation);
     this->AddModel(transform, rotation);
+    while (this->normalMatrix.size() < this->model.size())
+        this->normalMatrix.push_back(NormalMatrix(this->model[this->normalMatrix.size()]));
+}
+
+glm::mat3 Rasterizer::NormalMatrix(const glm::mat4& model)
+{
+    // the cofactor matrix is the inverse transpose times the determinant, without dividing by it; a mirroring
+    //   model has a negative determinant, which would turn the normals inside out
+    glm::mat3 m(model);
+    glm::mat3 cofactor(glm::cross(m[1], m[2]), glm::cross(m[2], m[0]), glm::cross(m[0], m[1]));
+    return glm::determinant(m) < 0.f ? -cofactor : cofactor;
 }
 
-void Rasterizer::InitZBuffer(ImageGrey& ZBuffer)
+void Rasterizer::InitZBuffer(DepthBuffer& ZBuffer)
 {
-    for (size_t i = 0; i != this->loader.GetHeight(); ++i)
-        for (size_t j = 0; j != this->loader.GetWidth(); ++j)
-            ZBuffer.Set(j, i, Rasterizer::zBufferDefault);
+    ZBuffer.Fill(Rasterizer::zBufferDefault);
 }
 
-void Rasterizer::DrawPrimitiveDepth(Triangle transformed, Triangle original, ImageGrey& ZBuffer)
+void Rasterizer::DrawPrimitiveDepth(Triangle transformed, const Triangle& original, DepthBuffer& ZBuffer)
 {
-    uint32_t xmax = 0, xmin = UINT32_MAX;
-    uint32_t ymax = 0, ymin = UINT32_MAX;
-    const std::array<glm::vec4, 3>& vertices = transformed.pos;
+    this->profiler.Add(Counter::TRIANGLES, 1);
+    TriangleSetup setup;
+    TriangleWalk walk;
+    if (!this->SetupTriangle(transformed, original, setup, walk))
+        return;
 
-    std::array<glm::vec3, 3> trimmedPos;
-    for (size_t ind = 0; ind != 3; ++ind)
+    if (!this->profiler.Enabled())
     {
-        const glm::vec4& v = vertices[ind];
-        if (v.x > xmax)
-            xmax = v.x;
-        if (v.x < xmin)
-            xmin = v.x;
-        if (v.y > ymax)
-            ymax = v.y;
-        if (v.y < ymin)
-            ymin = v.y;
-        trimmedPos[ind] = glm::vec3(v.x, v.y, 0);
+        walk.Visit(false, this->loader.GetTraversal(), [&](uint32_t x, uint32_t y)
+        {
+            this->UpdateDepthAtPixel(x, y, original, transformed, setup, ZBuffer);
+        });
+        return;
     }
 
-    for (uint32_t x = xmin; x <= xmax; ++x)
-        for (uint32_t y = ymin; y <= ymax; ++y)
-            this->UpdateDepthAtPixel(x, y, original, transformed, ZBuffer);
+    // the depth test lives in the student code, so a pass is detected as a change of the stored depth
+    uint64_t passed = 0;
+    uint64_t tested = walk.Visit(false, this->loader.GetTraversal(), [&](uint32_t x, uint32_t y)
+    {
+        std::optional<float> before = ZBuffer.Get(x, y);
+        this->UpdateDepthAtPixel(x, y, original, transformed, setup, ZBuffer);
+        if (before.has_value() && ZBuffer.Get(x, y) != before)
+            ++passed;
+    });
+    this->profiler.Add(Counter::PIXELS_TESTED, tested);
+    this->profiler.Add(Counter::PIXELS_PASSED, passed);
+}
+
+void Rasterizer::DrawPrimitiveDepth(Triangle transformed, const Triangle& original, DepthBuffer& ZBuffer, uint32_t id)
+{
+    this->profiler.Add(Counter::TRIANGLES, 1);
+    TriangleSetup setup;
+    TriangleWalk walk;
+    if (!this->SetupTriangle(transformed, original, setup, walk))
+        return;
+
+    // as above, a pass is detected as a change of the stored depth
+    uint64_t passed = 0;
+    uint64_t tested = walk.Visit(false, this->loader.GetTraversal(), [&](uint32_t x, uint32_t y)
+    {
+        std::optional<float> before = ZBuffer.Get(x, y);
+        this->UpdateDepthAtPixel(x, y, original, transformed, setup, ZBuffer);
+        if (before.has_value() && ZBuffer.Get(x, y) != before)
+        {
+            this->TriangleIds.Set(x, y, id);
+            ++passed;
+        }
+    });
+    this->profiler.Add(Counter::PIXELS_TESTED, tested);
+    this->profiler.Add(Counter::PIXELS_PASSED, passed);
+}
+
+void Rasterizer::DrawPrimitiveShaded(Triangle transformed, const Triangle& original, Image& image)
+{
+    TriangleSetup setup;
+    TriangleWalk walk;
+    if (!this->SetupTriangle(transformed, original, setup, walk))
+        return;
+
+    uint64_t shaded = walk.Visit(false, this->loader.GetTraversal(), [&](uint32_t x, uint32_t y)
+    {
+        this->ShadeAtPixel(x, y, original, transformed, setup, image);
+    });
+    this->profiler.Add(Counter::PIXELS_SHADED, shaded);
+}
+
+bool Rasterizer::IsTransparent(const Triangle& original) const
+{
+    const std::vector<Material>& materials = this->loader.GetMaterials();
+    return original.materialId >= 0 && static_cast<size_t>(original.materialId) < materials.size() &&
+        materials[original.materialId].dissolve < 1.f;
 }
 
-void Rasterizer::DrawPrimitiveShaded(Triangle transformed, Triangle original, Image& image)
+void Rasterizer::DrawPrimitiveTransparent(Triangle transformed, const Triangle& original, FragmentBuffer& fragments)
 {
-    uint32_t xmax = 0, xmin = UINT32_MAX;
-    uint32_t ymax = 0, ymin = UINT32_MAX;
-    const std::array<glm::vec4, 3>& vertices = transformed.pos;
+    const std::vector<Material>& materials = this->loader.GetMaterials();
+    float dissolve = original.materialId >= 0 && static_cast<size_t>(original.materialId) < materials.size() ?
+        materials[original.materialId].dissolve : 1.f;
+    this->profiler.Add(Counter::TRIANGLES, 1);
+    TriangleSetup setup;
+    TriangleWalk walk;
+    if (!this->SetupTriangle(transformed, original, setup, walk))
+        return;
+
+    // The student depth test against the opaque depth tells whether the triangle covers the pixel in front of it.
+    //   While the fragment depth is in the ZBuffer, ShadeAtPixel sees the fragment as the visible surface
+    uint64_t stored = 0;
+    uint64_t tested = walk.Visit(false, this->loader.GetTraversal(), [&](uint32_t x, uint32_t y)
+    {
+        std::optional<float> opaque = this->ZBuffer.Get(x, y);
+        if (!opaque.has_value())
+            return;
+        this->UpdateDepthAtPixel(x, y, original, transformed, setup, this->ZBuffer);
+        float depth = this->ZBuffer.Get(x, y).value();
+        if (depth == opaque.value())
+            return;
+
+        this->ShadeAtPixel(x, y, original, transformed, setup, fragments.scratch);
+        float alpha = dissolve * this->SampleDiffuse(x, y, original, setup).a;
+        this->ZBuffer.Set(x, y, opaque.value());
+        if (alpha > 0.f)
+        {
+            fragments.Insert(x, y, depth, fragments.scratch.Get(x, y).value(), alpha);
+            ++stored;
+        }
+    });
+    this->profiler.Add(Counter::PIXELS_TESTED, tested);
+    this->profiler.Add(Counter::PIXELS_SHADED, stored);
+    this->profiler.Add(Counter::FRAGMENTS, stored);
+}
 
-    std::array<glm::vec3, 3> trimmedPos;
-    for (size_t ind = 0; ind != 3; ++ind)
+bool Rasterizer::SetupTriangle(Triangle& transformed, const Triangle& original, TriangleSetup& setup,
+    TriangleWalk& walk) const
+{
+    if (!walk.Setup(transformed, this->loader.GetWidth(), this->loader.GetHeight(), this->loader.GetFixedPoint()))
+        return false;
+    if (this->scissor.has_value() && !walk.Clip(this->scissor.value()))
+        return false;
+
+    // `transformed` has been homogenized, so recover the clip-space w of each vertex for perspective correction
+    glm::mat4 clip = this->projection * this->view;
+    glm::vec3 inverseW;
+    for (size_t i = 0; i != 3; ++i)
     {
-        const glm::vec4& v = vertices[ind];
-        if (v.x > xmax)
-            xmax = v.x;
-        if (v.x < xmin)
-            xmin = v.x;
-        if (v.y > ymax)
-            ymax = v.y;
-        if (v.y < ymin)
-            ymin = v.y;
-        trimmedPos[ind] = glm::vec3(v.x, v.y, 0);
+        float w = (clip * original.pos[i]).w;
+        inverseW[i] = w > 0.f ? 1.f / w : 1.f;
     }
+    setup.Build(transformed, inverseW, walk);
+    return true;
+}
 
-    for (uint32_t x = xmin; x <= xmax; ++x)
-        for (uint32_t y = ymin; y <= ymax; ++y)
-            this->ShadeAtPixel(x, y, original, transformed, image);
+glm::vec4 Rasterizer::SampleDiffuse(uint32_t x, uint32_t y, const Triangle& original, const TriangleSetup& setup) const
+{
+    const std::vector<Material>& materials = this->loader.GetMaterials();
+    if (original.materialId < 0 || static_cast<size_t>(original.materialId) >= materials.size())
+        return glm::vec4(1.f);
+    int32_t textureId = materials[original.materialId].diffuseTexture;
+    if (textureId < 0)
+        return glm::vec4(1.f);
+    const Texture& texture = this->loader.GetTextures()[textureId];
+
+    auto uvAt = [&](glm::vec2 q)
+    {
+        glm::vec3 weights = setup.PerspectiveBarycentric(q);
+        return weights.x * original.uv[0] + weights.y * original.uv[1] + weights.z * original.uv[2];
+    };
+
+    glm::vec2 center(static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f);
+    glm::vec2 uv = uvAt(center);
+    glm::vec2 dUVdx = uvAt(center + glm::vec2(1.f, 0.f)) - uv;
+    glm::vec2 dUVdy = uvAt(center + glm::vec2(0.f, 1.f)) - uv;
+    return texture.Sample(uv, dUVdx, dUVdy);
 }
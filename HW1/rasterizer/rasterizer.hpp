@@ -1,33 +1,67 @@
 #ifndef RASTERIZER_H
 #define RASTERIZER_H
 
+#include "depthbuffer.hpp"
 #include "entities.hpp"
+#include "fragmentbuffer.hpp"
 #include "image.hpp"
 #include "loader.hpp"
+#include "profiler.hpp"
+#include "raster.hpp"
+#include "ssao.hpp"
 #include <cstdint>
+#include <memory>
+#include <optional>
 
 class Rasterizer
 {
 public:
-    Rasterizer(Loader& loader);
+    // The rasterizer only reads `loader`, and keeps every buffer it writes to itself, so renders with separate
+    //   rasterizers can run concurrently
+    Rasterizer(const Loader& loader);
 
     /// rasterizer.cpp
     // Render a single triangle, with no transformations, and possible anti-aliasing, based on config
     void DrawPrimitiveRaw(Image& image, Triangle trig, AntiAliasConfig config, uint32_t spp);
 
 
-    // Add a model to the rasterizer. Provide rotation part of the transformation, and dispatch to the impl version
+    // Add a model to the rasterizer. Provide rotation part of the transformation, and dispatch to the impl version.
+    //   The normal matrix of every model the impl version added is appended to `normalMatrix`
     void AddModel(MeshTransform transform);
 
+    // Transforms normals like `model` transforms points: the inverse transpose of its upper 3x3, up to a positive
+    //   scale, which the normalization after it removes. Singular models (a zero scale) still give a matrix
+    static glm::mat3 NormalMatrix(const glm::mat4& model);
+
 
     // Initialize the ZBuffer with the default value specified in impl
-    void InitZBuffer(ImageGrey& ZBuffer);
+    void InitZBuffer(DepthBuffer& ZBuffer);
 
     // Render the depth information of a single triangle.
-    void DrawPrimitiveDepth(Triangle transformed, Triangle original, ImageGrey& ZBuffer);
+    void DrawPrimitiveDepth(Triangle transformed, const Triangle& original, DepthBuffer& ZBuffer);
+
+    // Render the depth of a single triangle, and store `id` in `TriangleIds` at every pixel whose depth it updated
+    void DrawPrimitiveDepth(Triangle transformed, const Triangle& original, DepthBuffer& ZBuffer, uint32_t id);
 
     // Render a single triangle, with blinn-phong shading
-    void DrawPrimitiveShaded(Triangle transformed, Triangle original, Image& image);
+    void DrawPrimitiveShaded(Triangle transformed, const Triangle& original, Image& image);
+
+    // Shade a translucent triangle into `fragments` wherever it lies in front of the opaque depth in `ZBuffer`,
+    //   leaving `ZBuffer` unchanged. The opacity of a fragment is the material dissolve times the texture alpha
+    void DrawPrimitiveTransparent(Triangle transformed, const Triangle& original, FragmentBuffer& fragments);
+
+    // True if the triangle's material is not fully opaque (dissolve < 1)
+    bool IsTransparent(const Triangle& original) const;
+
+    // Snap `transformed` if the `fixedPoint` config is on, and compute the constants passed to the per-pixel
+    //   functions and the pixels to visit, within the scissor if there is one. Returns false if the triangle covers
+    //   no pixel
+    bool SetupTriangle(Triangle& transformed, const Triangle& original, TriangleSetup& setup, TriangleWalk& walk) const;
+
+    // Sample the diffuse texture of the triangle's material at the center of pixel (x, y), with perspective-correct
+    //   uv and trilinear filtering. Returns (1, 1, 1, 1) if the material has no texture, so it can always be used
+    //   as a multiplier on the diffuse term inside `ShadeAtPixel`
+    glm::vec4 SampleDiffuse(uint32_t x, uint32_t y, const Triangle& original, const TriangleSetup& setup) const;
 
     // rasterizer_impl.cpp
 
@@ -37,12 +71,14 @@ public:
      * @param x: x coordinate of the pixel
      * @param y: y coordinate of the pixel
      * @param trig: the triangle in which the pixel is considered; see class `Triangle` in `entities.hpp`
+     * @param setup: constants of `trig` computed once for all its pixels; see class `TriangleSetup` in `raster.hpp`
      * @param config: the anti-aliasing configuration, which can be either `NONE` or `SSAA`
      * @param spp: the number of samples per pixel. Only useful if config is set to `SSAA`
      * @param image: the image to render the pixel on. See class `Image` in `image.hpp` for APIs of read/write operations
      * @param color: the color to render the pixel with, if the pixel is completely inside the triangle
      */
-    void DrawPixel(uint32_t x, uint32_t y, Triangle trig, AntiAliasConfig config, uint32_t spp, Image& image, Color color);
+    void DrawPixel(uint32_t x, uint32_t y, const Triangle& trig, const TriangleSetup& setup, AntiAliasConfig config,
+        uint32_t spp, Image& image, Color color);
 
 
     /**
@@ -59,6 +95,7 @@ public:
 
     /**
      * Set the projection transformation matrix. This function does not take any argument as `Rasterizer` contains the camera information in the `loader` member.
+     * With `culling: true` in the config, visible points must land in OpenGL clip space: w > 0 and |x|, |y|, |z| <= w. Draws outside that volume are skipped.
      */
     void SetProjection();
 
@@ -74,7 +111,7 @@ public:
      * @param trig: the triangle to compute the barycentric coordinates with respect to
      * @return: the barycentric coordinates of the position with respect to the triangle
      */
-    glm::vec3 BarycentricCoordinate(glm::vec2 pos, Triangle trig);
+    glm::vec3 BarycentricCoordinate(glm::vec2 pos, const Triangle& trig);
 
     /**
      * Update the depth information at a single pixel in the ZBuffer. This function will be called for every pixel in the bounding box of the triangle.
@@ -82,9 +119,11 @@ public:
      * @param y: y coordinate of the pixel
      * @param original: the original triangle in the model space (before MVP transformation)
      * @param transformed: the transformed triangle in the screen space (after MVP transformation)
+     * @param setup: constants of `transformed` computed once for all its pixels, such as its barycentric and depth planes
      * @param ZBuffer: the ZBuffer to update the depth information in. See spec, or class `Image` in `image.hpp` for APIs of read/write operations
      */
-    void UpdateDepthAtPixel(uint32_t x, uint32_t y, Triangle original, Triangle transformed, ImageGrey& ZBuffer);
+    void UpdateDepthAtPixel(uint32_t x, uint32_t y, const Triangle& original, const Triangle& transformed,
+        const TriangleSetup& setup, DepthBuffer& ZBuffer);
 
     /**
      * Shade the pixel at the given position, using Blinn-Phong shading model. This function will be called for every pixel in the bounding box of the triangle.
@@ -92,26 +131,38 @@ public:
      * @param y: y coordinate of the pixel
      * @param original: the original triangle in the model space (before MVP transformation)
      * @param transformed: the transformed triangle in the screen space (after MVP transformation)
+     * @param setup: constants of `transformed` computed once for all its pixels, such as its barycentric and depth planes
      * @param image: the image to render the pixel on. See spec, or class `Image` in `image.hpp` for APIs of read/write operations
      */
-    void ShadeAtPixel(uint32_t x, uint32_t y, Triangle original, Triangle transformed, Image& image);
+    void ShadeAtPixel(uint32_t x, uint32_t y, const Triangle& original, const Triangle& transformed,
+        const TriangleSetup& setup, Image& image);
 
 public:
     // Configs
-    Loader& loader;
+    const Loader& loader;
     std::vector<glm::mat4x4> model;
+    std::vector<glm::mat3> normalMatrix;    // one per entry of `model`, see NormalMatrix
     glm::mat4x4 view;
     glm::mat4x4 projection;
     glm::mat4x4 screenspace;
+    std::optional<PixelRect> scissor;       // when set, pixels outside of it are neither tested nor written
 
     // Buffers
-    ImageGrey ZBuffer;
+    DepthBuffer ZBuffer;                    // in the format of the `depthFormat` config
+    ImageBuffer<uint32_t> TriangleIds;      // triangle that wrote the depth of each pixel, for early-Z shading
+    std::unique_ptr<FragmentBuffer> Fragments;      // translucent fragments; created by the first frame that has any
+    std::unique_ptr<AmbientOcclusion> Ssao;         // buffers of the SSAO pass; created by the first frame that uses it
+
+    static constexpr uint32_t NO_TRIANGLE = UINT32_MAX;
+
+    // Stage timings and pixel counters; enabled by the `profile` entry of the config
+    Profiler profiler;
 
     // Configurations 
     /** 
      * The default value for the ZBuffer during initialization.
      */
-    static float zBufferDefault;
+    static const float zBufferDefault;
 };
 
 #endif
@@ -5,7 +5,8 @@
 #include "rasterizer.hpp"
 
 // TODO
-void Rasterizer::DrawPixel(uint32_t x, uint32_t y, Triangle trig, AntiAliasConfig config, uint32_t spp, Image& image, Color color)
+void Rasterizer::DrawPixel(uint32_t x, uint32_t y, const Triangle& trig, const TriangleSetup& setup, AntiAliasConfig config,
+    uint32_t spp, Image& image, Color color)
 {
     if (config == AntiAliasConfig::NONE)            // if anti-aliasing is off
     {
@@ -73,16 +74,17 @@ void Rasterizer::SetScreenSpace()
 }
 
 // TODO
-glm::vec3 Rasterizer::BarycentricCoordinate(glm::vec2 pos, Triangle trig)
+glm::vec3 Rasterizer::BarycentricCoordinate(glm::vec2 pos, const Triangle& trig)
 {
     return glm::vec3();
 }
 
 // TODO
-float Rasterizer::zBufferDefault = float();
+const float Rasterizer::zBufferDefault = float();
 
 // TODO
-void Rasterizer::UpdateDepthAtPixel(uint32_t x, uint32_t y, Triangle original, Triangle transformed, ImageGrey& ZBuffer)
+void Rasterizer::UpdateDepthAtPixel(uint32_t x, uint32_t y, const Triangle& original, const Triangle& transformed,
+    const TriangleSetup& setup, DepthBuffer& ZBuffer)
 {
 
     float result;
@@ -92,7 +94,8 @@ void Rasterizer::UpdateDepthAtPixel(uint32_t x, uint32_t y, Triangle original, T
 }
 
 // TODO
-void Rasterizer::ShadeAtPixel(uint32_t x, uint32_t y, Triangle original, Triangle transformed, Image& image)
+void Rasterizer::ShadeAtPixel(uint32_t x, uint32_t y, const Triangle& original, const Triangle& transformed,
+    const TriangleSetup& setup, Image& image)
 {
 
     Color result;
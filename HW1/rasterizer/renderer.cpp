@@ -1,11 +1,21 @@
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <future>
 #include <iostream>
 #include <string>
+#include <utility>
 
+#include "fragmentbuffer.hpp"
+#include "depthbuffer.hpp"
+#include "frustum.hpp"
 #include "image.hpp"
 #include "loader.hpp"
+#include "occlusion.hpp"
+#include "radixsort.hpp"
 #include "rasterizer.hpp"
 #include "renderer.hpp"
+#include "ssao.hpp"
 
 void PrintTask(const Loader& loader)
 {
@@ -41,6 +51,54 @@ void PrintTaskTransformTest(const glm::vec3 input, const glm::vec4 output, const
     std::cout << msg;
 }
 
+// Largest scale factor of the axes of `modelMat`, bounding how much it stretches object-space distances
+float MaxScale(const glm::mat4& modelMat)
+{
+    return std::max({ glm::length(glm::vec3(modelMat[0])), glm::length(glm::vec3(modelMat[1])),
+        glm::length(glm::vec3(modelMat[2])) });
+}
+
+// View depth of the nearest point of the bounding sphere of `bounds` under `modelMat`, quantized over the
+//   clip range so that draws and chunks can be radix sorted front to back. `forward` is the unit view direction
+uint16_t DepthKey(const Camera& camera, glm::vec3 forward, const glm::mat4& modelMat, float scale, const Bounds& bounds)
+{
+    if (bounds.Empty())
+        return UINT16_MAX;
+
+    glm::vec3 center = glm::vec3(modelMat * glm::vec4(0.5f * (bounds.min + bounds.max), 1.f));
+    float radius = 0.5f * glm::length(bounds.max - bounds.min) * scale;
+    float depth = glm::dot(center - camera.pos, forward) - radius;
+    float t = (depth - camera.nearClip) / (camera.farClip - camera.nearClip);
+    if (!(t > 0.f))
+        return 0;
+    return static_cast<uint16_t>(std::min(t, 1.f) * static_cast<float>(UINT16_MAX));
+}
+
+// Level to draw for a shape with `bounds` under `modelMat`: one plus the index into `levels` of the coarsest level
+//   whose error, projected at the nearest point of the bounding sphere, stays within the configured pixel error.
+//   0 selects the full shape
+size_t SelectLodLevel(const Loader& loader, const Bounds& bounds, const glm::mat4& modelMat, const std::vector<LodLevel>& levels)
+{
+    if (levels.empty() || bounds.Empty())
+        return 0;
+
+    const Camera& camera = loader.GetCamera();
+    glm::vec3 center = glm::vec3(modelMat * glm::vec4(0.5f * (bounds.min + bounds.max), 1.f));
+    float scale = MaxScale(modelMat);
+    float radius = 0.5f * glm::length(bounds.max - bounds.min) * scale;
+    float distance = glm::length(center - camera.pos) - radius;
+    if (distance <= camera.nearClip || camera.height <= 0.f)
+        return 0;
+
+    // the near plane spans camera.height units over the image height
+    float pixelsPerUnit = static_cast<float>(loader.GetHeight()) * camera.nearClip / (distance * camera.height);
+    size_t selected = 0;
+    for (size_t level = 0; level != levels.size(); ++level)
+        if (levels[level].error * scale * pixelsPerUnit <= loader.GetLod().pixelError)
+            selected = level + 1;
+    return selected;
+}
+
 void Renderer::Render(int argc, char** argv)
 {
     std::string modelName;
@@ -52,15 +110,161 @@ void Renderer::Render(int argc, char** argv)
         std::cout << "using customized config name" << yamlConfigName << std::endl;
     }
 
+    this->RenderConfig(yamlConfigName);
+}
+
+bool Renderer::RenderConfig(const std::string& yamlConfigName, AssetCache* cache, std::optional<std::string> outputName)
+{
+    Profiler::Clock::time_point loadStart = Profiler::Clock::now();
     Loader loader(yamlConfigName);
-    bool success = loader.Load();
+    bool success = loader.Load(cache);
+    Profiler::Clock::time_point loadEnd = Profiler::Clock::now();
 
     if (success)
     {
+        if (outputName.has_value())
+            loader.SetOutputName(outputName.value());
+
         PrintTask(loader);
         Image image(loader.GetWidth(), loader.GetHeight(), loader.GetOutputName());
 
         Rasterizer rasterizer(loader);
+        if (rasterizer.profiler.Enabled())
+            rasterizer.profiler.Record("load", loadStart, loadEnd);
+
+        if (loader.GetAnimation().frames > 0)
+            this->RenderAnimation(loader, rasterizer, image);
+        else if (loader.GetProgressive() && (loader.GetType() == TestType::TRANSFORM ||
+            loader.GetType() == TestType::SHADING_DEPTH || loader.GetType() == TestType::SHADING))
+        {
+            FrameHistory history;
+            this->RenderProgressive(loader, rasterizer, image, history, [&](Image& stageImage, DepthBuffer& depth, uint32_t)
+            {
+                Profiler::Scope scope(rasterizer.profiler, "write");
+                if (loader.GetType() == TestType::SHADING_DEPTH)
+                    depth.Write();
+                else
+                    stageImage.Write();
+            });
+        }
+        else
+        {
+            this->RenderFrame(loader, rasterizer, image);
+
+            Profiler::Scope scope(rasterizer.profiler, "write");
+            if (loader.GetType() == TestType::SHADING_DEPTH)
+                rasterizer.ZBuffer.Write();
+            else if (loader.GetType() != TestType::TRANSFORM_TEST)
+                image.Write();
+        }
+
+        if (rasterizer.profiler.Enabled())
+        {
+            rasterizer.profiler.PrintSummary(std::cout);
+            const std::string& trace = loader.GetProfile().trace;
+            if (!trace.empty() && !rasterizer.profiler.WriteTrace(trace))
+                std::cerr << "[WARNING] failed to write profile trace " << trace << std::endl;
+        }
+    }
+    return success;
+}
+
+namespace
+{
+    // A draw that reached the rasterizer, kept so that a later pass can assemble it again
+    struct DrawnItem
+    {
+        size_t draw;                        // into FrameState::drawItems
+        Visibility visibility;
+        uint32_t firstTriangle;             // id of the first triangle of the draw in `rasterizer.TriangleIds`
+    };
+
+    // Everything the passes of one frame share: the draw list, the switches derived from the config, and the
+    //   vertex stage output of the draw being drawn. Each pass of RenderFrame reads and updates it in turn
+    struct FrameState
+    {
+        FrameState(const Loader& loader, Rasterizer& rasterizer, Image& image, FrameHistory* history,
+            const glm::mat4& viewxprojection, std::vector<DrawItem> drawItems) :
+            loader(loader),
+            rasterizer(rasterizer),
+            image(image),
+            history(history),
+            viewxprojection(viewxprojection),
+            drawItems(std::move(drawItems)),
+            depthTask(loader.GetType() == TestType::SHADING_DEPTH || loader.GetType() == TestType::SHADING),
+            // the matrices of the triangle task are not a perspective projection, so nothing is culled there
+            cull(loader.GetCulling() && loader.GetType() != TestType::TRIANGLE),
+            sortDepth(loader.GetSort() && this->depthTask),
+            earlyZ(loader.GetEarlyZ() && loader.GetType() == TestType::SHADING),
+            transparency(loader.GetTransparency() && loader.GetType() == TestType::SHADING),
+            forward(glm::normalize(loader.GetCamera().lookAt - loader.GetCamera().pos)),
+            occlusionBuffer(viewxprojection, loader.GetCamera(), rasterizer.ZBuffer.GetWidth(),
+                rasterizer.ZBuffer.GetHeight(), Rasterizer::zBufferDefault)
+        {   }
+
+        // init to identity so that the program will no crash even without model matrices being added
+        inline glm::mat4 ModelOf(const DrawItem& item) const
+        {
+            return item.model < this->rasterizer.model.size() ? this->rasterizer.model[item.model] : glm::mat4(1.f);
+        }
+        inline glm::mat3 NormalMatrixOf(const DrawItem& item) const
+        {
+            return item.model < this->rasterizer.normalMatrix.size() ? this->rasterizer.normalMatrix[item.model] :
+                Rasterizer::NormalMatrix(this->ModelOf(item));
+        }
+        inline Frustum FrustumOf(const glm::mat4& modelMat) const
+        {
+            return Frustum(this->rasterizer.projection * this->rasterizer.view * modelMat);
+        }
+        // whether triangle `i` of the assembled draw belongs to the opaque passes
+        inline bool Opaque(size_t i) const
+        {
+            return !this->transparency || !this->rasterizer.IsTransparent(this->originalTrigs[i]);
+        }
+
+        const Loader& loader;
+        Rasterizer& rasterizer;
+        Image& image;
+        FrameHistory* history;
+
+        glm::mat4 viewxprojection;          // screenspace * projection * view, depth reversed if configured
+        std::vector<DrawItem> drawItems;    // in submission order until CullAndSort, then in drawing order
+
+        const bool depthTask;               // SHADING_DEPTH or SHADING
+        const bool cull;
+        const bool sortDepth;
+        const bool earlyZ;
+        const bool transparency;
+        bool recordVisible = false;         // see FrameHistory::recordVisible; set by KeepHistory
+        const glm::vec3 forward;            // unit view direction
+
+        std::vector<uint8_t> seed;          // draws visible in the previous stage, see FrameHistory::visible
+        OcclusionBuffer occlusionBuffer;
+        size_t occluderCount = 0;           // the first draws of the list, drawn before occlusion tests start
+
+        std::vector<DrawnItem> drawn;       // early-Z: every draw whose depth was drawn
+        std::vector<DrawnItem> translucent; // draws holding transparent triangles
+        uint32_t triangleCount = 0;         // early-Z: triangle ids given out so far
+
+        // Vertex stage output of the draw being drawn, and its scratch buffers
+        std::vector<Triangle> transformedTrigs;
+        std::vector<Triangle> originalTrigs;
+        std::vector<glm::vec4> screenPos;
+        std::vector<glm::vec4> worldPos;
+        std::vector<glm::vec4> worldNormal;
+        std::vector<uint8_t> transformedSlot;
+        std::vector<uint8_t> transformedNormal;
+        std::vector<uint16_t> depthKeys;
+        std::vector<uint32_t> depthOrder;
+    };
+
+    // Load the model matrices into the rasterizer, list the draws in submission order and return the matrix taking
+    //   world space to the screen
+    glm::mat4 SetupDraws(const Loader& loader, Rasterizer& rasterizer, std::vector<DrawItem>& drawItems)
+    {
+        rasterizer.model.clear();
+        rasterizer.normalMatrix.clear();
+        rasterizer.scissor.reset();
 
         glm::mat4x4 viewxprojection{
             1, 0, 0, 0,
@@ -81,6 +285,9 @@ void Renderer::Render(int argc, char** argv)
                 halfWidth, halfHeight, 0, 1
             };
             rasterizer.model.push_back(glm::mat4x4(1.0f));      // Add an identity model matrix to avoid special judgement below
+            rasterizer.normalMatrix.push_back(glm::mat3(1.f));
+            for (size_t s = 0; s != loader.GetShapes().size(); ++s)
+                drawItems.push_back({ s, s });
         }
         else
         {
@@ -91,114 +298,662 @@ void Renderer::Render(int argc, char** argv)
                 rasterizer.AddModel(transform);
             }
 
+            // Instanced shapes are drawn once per instance transform instead of with their own transform;
+            //   the instance matrices follow the per-shape ones in `rasterizer.model`
+            std::vector<bool> instanced(loader.GetShapes().size(), false);
+            std::vector<DrawItem> instanceItems;
+            for (const InstanceGroup& group : loader.GetInstances())
+            {
+                instanced[group.shape] = true;
+                for (const MeshTransform& transform : group.transforms)
+                {
+                    instanceItems.push_back({ static_cast<size_t>(group.shape), rasterizer.model.size() });
+                    rasterizer.AddModel(transform);
+                }
+            }
+            for (size_t s = 0; s != loader.GetShapes().size(); ++s)
+                if (!instanced[s])
+                    drawItems.push_back({ s, s < loader.GetTransforms().size() ? s : DrawItem::NO_MODEL });
+            drawItems.insert(drawItems.end(), instanceItems.begin(), instanceItems.end());
+
             rasterizer.SetView();
             rasterizer.SetProjection();
             rasterizer.SetScreenSpace();
 
             // Compose the matrices
             viewxprojection = rasterizer.screenspace * rasterizer.projection * rasterizer.view;
+
+            // reversed-Z replaces the depth that the shading tasks test and store
+            if ((loader.GetType() == TestType::SHADING_DEPTH || loader.GetType() == TestType::SHADING) &&
+                loader.GetDepthFormat() == DepthFormat::REVERSED)
+                viewxprojection = ReverseDepth(viewxprojection, loader.GetCamera());
         }
-        
-        // If this is test on transforms, then do not need to iterate over the meshes
-        if (loader.GetType() == TestType::TRANSFORM_TEST)
-        {
-            glm::vec3 input = loader.GetTestInput();
-            glm::vec3 expected = loader.GetTestExpected();
-            glm::vec4 input4(input, 1);
 
-            if (rasterizer.model.size() == 0)
-                throw std::runtime_error("No model matrix specified for transform test");
+        for (size_t d = 0; d != drawItems.size(); ++d)
+            drawItems[d].index = d;
+        return viewxprojection;
+    }
+
+    // Partial re-render: when the view and the draws are those of the previous frame, the rest of the image and
+    //   depth is kept, and only the screen rectangles of the draws that moved, before and after, are drawn again.
+    //   From another view, the draws visible in the previous frame (if recorded) seed the occlusion test instead.
+    //   The history is then updated to this frame
+    void KeepHistory(FrameState& frame)
+    {
+        const Loader& loader = frame.loader;
+        FrameHistory* history = frame.history;
+        if (!history || !(loader.GetType() == TestType::TRANSFORM || frame.depthTask))
+            return;
 
-            glm::vec4 output = viewxprojection * rasterizer.model[0] * input4;
-            PrintTaskTransformTest(input, output, expected);
+        std::vector<glm::mat4> models;
+        std::vector<PixelRect> rects;
+        for (const DrawItem& item : frame.drawItems)
+        {
+            models.push_back(frame.ModelOf(item));
+            rects.push_back(ScreenRect(frame.viewxprojection * models.back(), loader.GetShapeBounds()[item.shape].bounds,
+                loader.GetWidth(), loader.GetHeight()));
         }
-        else 
+
+        const std::vector<DrawItem>& drawItems = frame.drawItems;
+        bool sameDraws = history->valid && history->drawItems.size() == drawItems.size();
+        for (size_t d = 0; sameDraws && d != drawItems.size(); ++d)
+            sameDraws = history->drawItems[d].shape == drawItems[d].shape && history->drawItems[d].model == drawItems[d].model;
+        // the pixels kept must be those of buffers of this size, whatever the screen matrix; ambient occlusion
+        //   reaches past the rectangle of a draw, and is already applied to the pixels kept
+        bool same = sameDraws && history->screen == frame.viewxprojection && history->width == loader.GetWidth() &&
+            history->height == loader.GetHeight() && !loader.GetAmbientOcclusion().enabled;
+        if (sameDraws && !same)
+            frame.seed = std::move(history->visible);
+        if (same)
         {
-            auto& shapes = loader.GetShapes();
-            auto& attribs = loader.GetAttribs();
+            PixelRect dirty;
+            for (size_t d = 0; d != drawItems.size(); ++d)
+                if (models[d] != history->models[d])
+                {
+                    dirty.Extend(history->rects[d]);
+                    dirty.Extend(rects[d]);
+                }
+            frame.rasterizer.scissor = dirty;
+        }
 
-            if (loader.GetType() == TestType::SHADING_DEPTH || loader.GetType() == TestType::SHADING)
+        history->valid = true;
+        history->screen = frame.viewxprojection;
+        history->width = loader.GetWidth();
+        history->height = loader.GetHeight();
+        history->drawItems = drawItems;
+        history->models = std::move(models);
+        history->rects = std::move(rects);
+
+        // visibility is only known for the pixels drawn
+        frame.recordVisible = history->recordVisible && !frame.rasterizer.scissor.has_value() && frame.depthTask;
+        if (frame.recordVisible)
+            history->visible.assign(drawItems.size(), 0);
+        else
+            history->visible.clear();
+    }
+
+    // Clear the image, and the depth and triangle ids where the passes need them, within the scissor if any
+    void ClearBuffers(FrameState& frame)
+    {
+        Rasterizer& rasterizer = frame.rasterizer;
+        if (rasterizer.scissor.has_value())
+        {
+            const PixelRect& scissor = rasterizer.scissor.value();
+            frame.image.Fill(Color::Black, scissor.xmin, scissor.ymin, scissor.xmax, scissor.ymax);
+        }
+        else
+            frame.image.Fill(Color::Black);
+
+        if (frame.depthTask)
+        {
+            // a packed depth covers the range between the clip planes
+            const Camera& camera = frame.loader.GetCamera();
+            float nearDepth = DepthAt(frame.viewxprojection, camera, camera.nearClip);
+            float farDepth = DepthAt(frame.viewxprojection, camera, camera.farClip);
+            rasterizer.ZBuffer.SetFormat(frame.loader.GetDepthFormat(), std::min(nearDepth, farDepth),
+                std::max(nearDepth, farDepth), Rasterizer::zBufferDefault);
+            if (rasterizer.scissor.has_value())
+            {
+                const PixelRect& scissor = rasterizer.scissor.value();
+                rasterizer.ZBuffer.Fill(Rasterizer::zBufferDefault, scissor.xmin, scissor.ymin, scissor.xmax, scissor.ymax);
+            }
+            else
                 rasterizer.InitZBuffer(rasterizer.ZBuffer);
+        }
+
+        if (frame.earlyZ || frame.recordVisible)
+            rasterizer.TriangleIds.Fill(Rasterizer::NO_TRIANGLE);
+    }
+
+    // The transform test prints where the test input lands instead of drawing anything
+    void TransformTest(FrameState& frame)
+    {
+        glm::vec3 input = frame.loader.GetTestInput();
+        glm::vec3 expected = frame.loader.GetTestExpected();
+        glm::vec4 input4(input, 1);
+
+        if (frame.rasterizer.model.size() == 0)
+            throw std::runtime_error("No model matrix specified for transform test");
+
+        glm::vec4 output = frame.viewxprojection * frame.rasterizer.model[0] * input4;
+        PrintTaskTransformTest(input, output, expected);
+    }
+
+    // Order the draw list. Occlusion culling: draws covering a large part of the screen go first, and once their
+    //   depth is in the ZBuffer, the boxes of the remaining draws are tested against a coarse copy of it. With a
+    //   seed, the draws visible in the previous frame go first instead, whether or not the config asks for occlusion
+    //   culling. Front to back order: the occluders and the rest are then each sorted by view depth, so that the
+    //   depth test rejects as much of the hidden geometry as possible
+    void CullAndSort(FrameState& frame)
+    {
+        const Loader& loader = frame.loader;
+        const std::vector<ShapeBounds>& shapeBounds = loader.GetShapeBounds();
+        std::vector<DrawItem>& drawItems = frame.drawItems;
 
-            std::vector<Triangle> transformedTrigs;
-            std::vector<Triangle> originalTrigs;
-            
-            const size_t fv = 3;
-            for (size_t s = 0; s < shapes.size(); s++) 
+        const bool seeded = frame.cull && frame.seed.size() == drawItems.size() && frame.depthTask;
+        const bool occlusion = seeded || (frame.cull && loader.GetOcclusion().enabled && frame.depthTask);
+        if (occlusion && frame.occlusionBuffer.Valid())
+        {
+            float minArea = loader.GetOcclusion().occluderArea * static_cast<float>(loader.GetWidth()) *
+                static_cast<float>(loader.GetHeight());
+            auto isOccluder = [&](const DrawItem& item)
             {
-                if (loader.GetType() == TestType::SHADING)
-                {
-                    transformedTrigs.clear();
-                    originalTrigs.clear();
-                    transformedTrigs.reserve(shapes.size());
-                    originalTrigs.reserve(shapes.size());
-                }
+                if (seeded)
+                    return frame.seed[item.index] != 0;
+                return frame.occlusionBuffer.ScreenArea(frame.viewxprojection * frame.ModelOf(item),
+                    shapeBounds[item.shape].bounds) >= minArea;
+            };
+            frame.occluderCount = std::stable_partition(drawItems.begin(), drawItems.end(), isOccluder) - drawItems.begin();
+        }
 
-                // Loop over faces(polygon)
-                size_t index_offset = 0;
-                for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) 
-                {
-                    // Loop over vertices in the face.
-                    Triangle transformed, original;
-                    for (size_t v = 0; v < fv; v++) 
+        if (!frame.sortDepth)
+            return;
+        auto sortRange = [&](size_t first, size_t last)
+        {
+            frame.depthKeys.clear();
+            for (size_t d = first; d != last; ++d)
+            {
+                glm::mat4 modelMat = frame.ModelOf(drawItems[d]);
+                frame.depthKeys.push_back(DepthKey(loader.GetCamera(), frame.forward, modelMat, MaxScale(modelMat),
+                    shapeBounds[drawItems[d].shape].bounds));
+            }
+            RadixSortIndices(frame.depthKeys, frame.depthOrder);
+            std::vector<DrawItem> sorted;
+            sorted.reserve(last - first);
+            for (uint32_t index : frame.depthOrder)
+                sorted.push_back(drawItems[first + index]);
+            std::copy(sorted.begin(), sorted.end(), drawItems.begin() + first);
+        };
+        sortRange(0, frame.occluderCount);
+        sortRange(frame.occluderCount, drawItems.size());
+    }
+
+    // Select the level of detail of a draw and run its vertex stage into transformedTrigs/originalTrigs. The
+    //   faces come out in the same order every time, so the early-Z shading pass can assemble a draw again
+    //   and find its triangles by index; `replay` keeps that second run out of the counters and the log
+    void AssembleDraw(FrameState& frame, const DrawItem& item, const glm::mat4& modelMat, const Frustum& frustum,
+        Visibility visibility, bool replay)
+    {
+        const Loader& loader = frame.loader;
+        const tinyobj::attrib_t& attribs = loader.GetAttribs();
+        const std::vector<std::vector<LodLevel>>& lods = loader.GetLods();
+        const size_t s = item.shape;
+        const size_t fv = 3;
+
+        // Level of detail: a simplified level replaces the full shape for distant draws
+        const LodLevel* lodLevel = nullptr;
+        if (s < lods.size() && loader.GetType() != TestType::TRIANGLE)
+        {
+            size_t level = SelectLodLevel(loader, loader.GetShapeBounds()[s].bounds, modelMat, lods[s]);
+            if (level > 0)
+                lodLevel = &lods[s][level - 1];
+        }
+        const tinyobj::mesh_t& mesh = lodLevel ? lodLevel->shape.mesh : loader.GetShapes()[s].mesh;
+        const ShapeVertices& vertices = lodLevel ? lodLevel->vertices : loader.GetShapeVertices()[s];
+        const ShapeBounds& bounds = lodLevel ? lodLevel->bounds : loader.GetShapeBounds()[s];
+
+        std::vector<Triangle>& transformedTrigs = frame.transformedTrigs;
+        std::vector<Triangle>& originalTrigs = frame.originalTrigs;
+        transformedTrigs.clear();
+        originalTrigs.clear();
+        transformedTrigs.reserve(mesh.num_face_vertices.size());
+        originalTrigs.reserve(mesh.num_face_vertices.size());
+
+        // Vertex stage: transform the unique vertices of the shape once, then assemble its faces
+        Profiler::Scope scope(frame.rasterizer.profiler, "vertex");
+
+        glm::mat4 mvp = loader.GetType() == TestType::TRIANGLE ? frame.viewxprojection : frame.viewxprojection * modelMat;
+        glm::mat3 normalMat = frame.NormalMatrixOf(item);
+
+        const std::vector<uint32_t>& positions = vertices.positions;
+        frame.screenPos.resize(positions.size());
+        frame.worldPos.resize(positions.size());
+        auto transformVertex = [&](size_t i)
+        {
+            const tinyobj::real_t* v = &attribs.vertices[3 * size_t(positions[i])];
+            glm::vec4 vec(v[0], v[1], v[2], 1);
+            frame.screenPos[i] = mvp * vec;
+            frame.worldPos[i] = modelMat * vec;
+        };
+
+        // normals are directions (w = 0), normalized once per unique normal rather than at every pixel
+        const std::vector<uint32_t>& normals = vertices.normals;
+        frame.worldNormal.resize(normals.size());
+        auto transformNormal = [&](size_t i)
+        {
+            const tinyobj::real_t* n = &attribs.normals[3 * size_t(normals[i])];
+            glm::vec3 normal = normalMat * glm::vec3(n[0], n[1], n[2]);
+            float length2 = glm::dot(normal, normal);
+            frame.worldNormal[i] = glm::vec4(length2 > 0.f ? normal / std::sqrt(length2) : normal, 0.f);
+        };
+
+        // A draw completely inside is transformed in one pass; otherwise only the vertices of
+        //   visible chunks are transformed, on first use
+        const bool lazy = visibility == Visibility::INTERSECTING;
+        if (lazy)
+        {
+            frame.transformedSlot.assign(positions.size(), 0);
+            frame.transformedNormal.assign(normals.size(), 0);
+        }
+        else
+        {
+            for (size_t i = 0; i != positions.size(); ++i)
+                transformVertex(i);
+            for (size_t i = 0; i != normals.size(); ++i)
+                transformNormal(i);
+        }
+
+        frame.depthOrder.clear();
+        if (frame.sortDepth && bounds.chunks.size() > 1)
+        {
+            float scale = MaxScale(modelMat);
+            frame.depthKeys.clear();
+            for (const ShapeBounds::Chunk& chunk : bounds.chunks)
+                frame.depthKeys.push_back(DepthKey(loader.GetCamera(), frame.forward, modelMat, scale, chunk.bounds));
+            RadixSortIndices(frame.depthKeys, frame.depthOrder);
+        }
+
+        const std::vector<uint32_t>& corners = vertices.corners;
+        const std::vector<uint32_t>& normalCorners = vertices.normalCorners;
+        for (size_t c = 0; c != bounds.chunks.size(); ++c)
+        {
+            const ShapeBounds::Chunk& chunk = bounds.chunks[frame.depthOrder.empty() ? c : frame.depthOrder[c]];
+            if (lazy && frustum.Classify(chunk.bounds) == Visibility::OUTSIDE)
+            {
+                if (!replay)
+                    frame.rasterizer.profiler.Add(Counter::CHUNKS_CULLED, 1);
+                continue;
+            }
+
+            // Loop over faces(polygon)
+            for (size_t f = chunk.firstFace; f < chunk.firstFace + chunk.faceCount; f++) 
+            {
+                size_t index_offset = fv * f;
+                if (lazy)
+                    for (size_t v = 0; v < fv; v++)
                     {
-                        // access to vertex
-                        tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                        tinyobj::real_t vx = attribs.vertices[3 * size_t(idx.vertex_index) + 0];
-                        tinyobj::real_t vy = attribs.vertices[3 * size_t(idx.vertex_index) + 1];
-                        tinyobj::real_t vz = attribs.vertices[3 * size_t(idx.vertex_index) + 2];
-                        glm::vec4 vec(vx, vy, vz, 1);
-                        
-                        // init to identity so that the program will no crash even without model matrices being added
-                        glm::mat4 modelMat = glm::mat4(1.f);
-                        if (rasterizer.model.size() > s)
-                            modelMat = rasterizer.model[s];
-
-                        if (loader.GetType() == TestType::TRIANGLE)
-                            transformed.pos[v] = viewxprojection * vec;
-                        else
-                            transformed.pos[v] = viewxprojection * modelMat * vec;
-
-                        original.pos[v] = modelMat * vec;
-
-                        if (idx.normal_index >= 0) 
+                        if (!frame.transformedSlot[corners[index_offset + v]])
                         {
-                            tinyobj::real_t nx = attribs.normals[3 * size_t(idx.normal_index) + 0];
-                            tinyobj::real_t ny = attribs.normals[3 * size_t(idx.normal_index) + 1];
-                            tinyobj::real_t nz = attribs.normals[3 * size_t(idx.normal_index) + 2];
-                            original.normal[v] = modelMat * glm::vec4(nx, ny, nz, 1);
+                            transformVertex(corners[index_offset + v]);
+                            frame.transformedSlot[corners[index_offset + v]] = 1;
+                        }
+                        uint32_t normal = normalCorners[index_offset + v];
+                        if (normal != ShapeVertices::NO_NORMAL && !frame.transformedNormal[normal])
+                        {
+                            transformNormal(normal);
+                            frame.transformedNormal[normal] = 1;
                         }
                     }
 
-                    transformed.Homogenize();
+                // Loop over vertices in the face.
+                Triangle transformed, original;
+                for (size_t v = 0; v < fv; v++) 
+                {
+                    // access to vertex
+                    tinyobj::index_t idx = mesh.indices[index_offset + v];
+                    transformed.pos[v] = frame.screenPos[corners[index_offset + v]];
+                    original.pos[v] = frame.worldPos[corners[index_offset + v]];
+
+                    if (idx.texcoord_index >= 0)
+                    {
+                        original.uv[v].x = attribs.texcoords[2 * size_t(idx.texcoord_index) + 0];
+                        original.uv[v].y = attribs.texcoords[2 * size_t(idx.texcoord_index) + 1];
+                    }
+                    else
+                        original.uv[v] = glm::vec2(0.f);
+
+                    if (normalCorners[index_offset + v] != ShapeVertices::NO_NORMAL)
+                        original.normal[v] = frame.worldNormal[normalCorners[index_offset + v]];
+                }
+
+                if (f < mesh.material_ids.size())
+                    original.materialId = mesh.material_ids[f];
+                transformed.uv = original.uv;
+                transformed.materialId = original.materialId;
+
+                transformed.Homogenize();
 
 #if defined PRINT_TRIG_DETAIL
+                if (!replay)
                     PrintTaskTriangle(transformed);
 #endif
 
-                    if (loader.GetType() == TestType::TRIANGLE || loader.GetType() == TestType::TRANSFORM)
-                        rasterizer.DrawPrimitiveRaw(image, transformed, loader.GetAntiAliasConfig(), loader.GetSpp());
-                    else if (loader.GetType() == TestType::SHADING_DEPTH || loader.GetType() == TestType::SHADING)
-                        rasterizer.DrawPrimitiveDepth(transformed, original, rasterizer.ZBuffer);
-                    
-                    if (loader.GetType() == TestType::SHADING)
-                    {
-                        transformedTrigs.push_back(transformed);
-                        originalTrigs.push_back(original);
-                    }
+                transformedTrigs.push_back(transformed);
+                originalTrigs.push_back(original);
+            }
+        }
+    }
 
-                    index_offset += fv;
-                }
+    // Cull, assemble and draw every draw of the list in order: the raster tasks draw coverage, the others depth,
+    //   and SHADING without early-Z shades each triangle right after its depth. Transparent triangles are left to
+    //   TransparencyPass
+    void DrawPass(FrameState& frame)
+    {
+        const Loader& loader = frame.loader;
+        Rasterizer& rasterizer = frame.rasterizer;
+        const std::vector<ShapeBounds>& shapeBounds = loader.GetShapeBounds();
+        const std::vector<Triangle>& transformedTrigs = frame.transformedTrigs;
+        const std::vector<Triangle>& originalTrigs = frame.originalTrigs;
 
-                if (loader.GetType() == TestType::SHADING)
-                    for (size_t i = 0; i < transformedTrigs.size(); ++i)
-                        rasterizer.DrawPrimitiveShaded(transformedTrigs[i], originalTrigs[i], image);
+        for (size_t d = 0; d != frame.drawItems.size(); ++d) 
+        {
+            const DrawItem& item = frame.drawItems[d];
+            const size_t s = item.shape;
+            glm::mat4 modelMat = frame.ModelOf(item);
+
+            if (frame.occluderCount > 0 && d == frame.occluderCount)
+            {
+                Profiler::Scope scope(rasterizer.profiler, "occlusion");
+                frame.occlusionBuffer.Build(rasterizer.ZBuffer);
+            }
+
+            // Frustum culling: the whole draw first, then chunks of faces if the draw crosses the frustum
+            Frustum frustum = frame.FrustumOf(modelMat);
+            Visibility visibility = frame.cull ? frustum.Classify(shapeBounds[s].bounds) : Visibility::INSIDE;
+            if (visibility == Visibility::OUTSIDE)
+            {
+                rasterizer.profiler.Add(Counter::DRAWS_CULLED, 1);
+                continue;
+            }
+
+            if (frame.occluderCount > 0 && d >= frame.occluderCount &&
+                frame.occlusionBuffer.Occluded(frame.viewxprojection * modelMat, shapeBounds[s].bounds))
+            {
+                rasterizer.profiler.Add(Counter::DRAWS_OCCLUDED, 1);
+                continue;
+            }
+
+            // a partial re-render skips the draws that cannot reach the pixels being drawn again
+            if (rasterizer.scissor.has_value() && !ScreenRect(frame.viewxprojection * modelMat, shapeBounds[s].bounds,
+                loader.GetWidth(), loader.GetHeight()).Intersects(rasterizer.scissor.value()))
+                continue;
+
+            if (frame.earlyZ)
+                frame.drawn.push_back({ d, visibility, frame.triangleCount });
+            AssembleDraw(frame, item, modelMat, frustum, visibility, false);
+            if (frame.transparency && std::any_of(originalTrigs.begin(), originalTrigs.end(),
+                [&](const Triangle& trig) { return rasterizer.IsTransparent(trig); }))
+                frame.translucent.push_back({ d, visibility, 0 });
+
+            if (loader.GetType() == TestType::TRIANGLE || loader.GetType() == TestType::TRANSFORM)
+            {
+                Profiler::Scope scope(rasterizer.profiler, "raster");
+                for (const Triangle& transformed : transformedTrigs)
+                    rasterizer.DrawPrimitiveRaw(frame.image, transformed, loader.GetAntiAliasConfig(), loader.GetSpp());
+            }
+            else if (frame.earlyZ)
+            {
+                Profiler::Scope scope(rasterizer.profiler, "depth");
+                for (size_t i = 0; i < transformedTrigs.size(); ++i)
+                    if (frame.Opaque(i))
+                        rasterizer.DrawPrimitiveDepth(transformedTrigs[i], originalTrigs[i], rasterizer.ZBuffer,
+                            frame.triangleCount + static_cast<uint32_t>(i));
+                frame.triangleCount += static_cast<uint32_t>(transformedTrigs.size());
+            }
+            else if (frame.recordVisible)
+            {
+                // without early-Z, the ids only tell which draw owns each pixel
+                Profiler::Scope scope(rasterizer.profiler, "depth");
+                for (size_t i = 0; i < transformedTrigs.size(); ++i)
+                    if (frame.Opaque(i))
+                        rasterizer.DrawPrimitiveDepth(transformedTrigs[i], originalTrigs[i], rasterizer.ZBuffer,
+                            static_cast<uint32_t>(item.index));
+            }
+            else if (frame.depthTask)
+            {
+                Profiler::Scope scope(rasterizer.profiler, "depth");
+                for (size_t i = 0; i < transformedTrigs.size(); ++i)
+                    if (frame.Opaque(i))
+                        rasterizer.DrawPrimitiveDepth(transformedTrigs[i], originalTrigs[i], rasterizer.ZBuffer);
+            }
+
+            if (loader.GetType() == TestType::SHADING && !frame.earlyZ)
+            {
+                Profiler::Scope scope(rasterizer.profiler, "shading");
+                for (size_t i = 0; i < transformedTrigs.size(); ++i)
+                    if (frame.Opaque(i))
+                        rasterizer.DrawPrimitiveShaded(transformedTrigs[i], originalTrigs[i], frame.image);
             }
         }
+    }
+
+    // Without early-Z, DrawPass stored the index of the draw owning each pixel in the triangle ids
+    void RecordVisibleDraws(FrameState& frame)
+    {
+        const ImageBuffer<uint32_t>& ids = frame.rasterizer.TriangleIds;
+        for (uint32_t y = 0; y != ids.GetHeight(); ++y)
+            for (uint32_t x = 0; x != ids.GetWidth(); ++x)
+            {
+                uint32_t id = ids.Get(x, y).value();
+                if (id != Rasterizer::NO_TRIANGLE)
+                    frame.history->visible[id] = 1;
+            }
+    }
 
+    // Early-Z: DrawPass resolved the depth of every draw, recording which triangle wrote each pixel; the shading
+    //   then runs once per covered pixel, with that triangle only
+    void EarlyZShadePass(FrameState& frame)
+    {
+        Rasterizer& rasterizer = frame.rasterizer;
+        const std::vector<DrawnItem>& drawn = frame.drawn;
+
+        // Pixels grouped by the triangle that wrote their depth; ids grow with the draws, so the pixels of a
+        //   draw form one run
+        const uint32_t width = rasterizer.TriangleIds.GetWidth();
+        std::vector<uint64_t> covered;
+        for (uint32_t y = 0; y != rasterizer.TriangleIds.GetHeight(); ++y)
+            for (uint32_t x = 0; x != width; ++x)
+            {
+                uint32_t id = rasterizer.TriangleIds.Get(x, y).value();
+                if (id != Rasterizer::NO_TRIANGLE)
+                    covered.push_back((uint64_t(id) << 32) | (uint64_t(y) * width + x));
+            }
+        std::sort(covered.begin(), covered.end());
+
+        size_t next = 0;
+        for (size_t k = 0; k != drawn.size() && next != covered.size(); ++k)
+        {
+            uint32_t end = k + 1 < drawn.size() ? drawn[k + 1].firstTriangle : frame.triangleCount;
+            if ((covered[next] >> 32) >= end)
+                continue;
+
+            const DrawItem& item = frame.drawItems[drawn[k].draw];
+            if (frame.recordVisible)
+                frame.history->visible[item.index] = 1;
+            glm::mat4 modelMat = frame.ModelOf(item);
+            AssembleDraw(frame, item, modelMat, frame.FrustumOf(modelMat), drawn[k].visibility, true);
+
+            Profiler::Scope scope(rasterizer.profiler, "shading");
+            size_t first = next;
+            size_t current = SIZE_MAX;
+            TriangleSetup setup;
+            TriangleWalk walk;
+            for (; next != covered.size() && (covered[next] >> 32) < end; ++next)
+            {
+                // the pixels are sorted by triangle, so each triangle is set up once
+                size_t i = static_cast<size_t>(covered[next] >> 32) - drawn[k].firstTriangle;
+                if (i != current)
+                {
+                    rasterizer.SetupTriangle(frame.transformedTrigs[i], frame.originalTrigs[i], setup, walk);
+                    current = i;
+                }
+                uint32_t pixel = static_cast<uint32_t>(covered[next]);
+                rasterizer.ShadeAtPixel(pixel % width, pixel / width, frame.originalTrigs[i], frame.transformedTrigs[i],
+                    setup, frame.image);
+            }
+            rasterizer.profiler.Add(Counter::PIXELS_SHADED, next - first);
+        }
+    }
+
+    // Darken the opaque surfaces by screen-space ambient occlusion; before transparency, so that transparent
+    //   surfaces are blended over the occluded colors
+    void AmbientOcclusionPass(FrameState& frame)
+    {
+        Rasterizer& rasterizer = frame.rasterizer;
+        Profiler::Scope scope(rasterizer.profiler, "ssao");
+        if (!rasterizer.Ssao)
+            rasterizer.Ssao = std::make_unique<AmbientOcclusion>();
+        if (rasterizer.Ssao->SetView(frame.viewxprojection, frame.loader.GetCamera(), Rasterizer::zBufferDefault))
+            rasterizer.Ssao->Apply(rasterizer.ZBuffer, frame.image, frame.loader.GetAmbientOcclusion());
+    }
+
+    // Transparency: the draws holding triangles of materials with dissolve < 1 are assembled again, and the
+    //   fragments of those triangles are blended over the opaque image
+    void TransparencyPass(FrameState& frame)
+    {
+        Rasterizer& rasterizer = frame.rasterizer;
+        if (!rasterizer.Fragments)
+            rasterizer.Fragments = std::make_unique<FragmentBuffer>(frame.loader.GetWidth(), frame.loader.GetHeight());
+        rasterizer.Fragments->Reset();
+
+        for (const DrawnItem& entry : frame.translucent)
+        {
+            const DrawItem& item = frame.drawItems[entry.draw];
+            glm::mat4 modelMat = frame.ModelOf(item);
+            AssembleDraw(frame, item, modelMat, frame.FrustumOf(modelMat), entry.visibility, true);
+
+            Profiler::Scope scope(rasterizer.profiler, "transparency");
+            for (size_t i = 0; i < frame.transformedTrigs.size(); ++i)
+                if (!frame.Opaque(i))
+                    rasterizer.DrawPrimitiveTransparent(frame.transformedTrigs[i], frame.originalTrigs[i],
+                        *rasterizer.Fragments);
+        }
+
+        Profiler::Scope scope(rasterizer.profiler, "resolve");
+        rasterizer.Fragments->Resolve(frame.image, frame.occlusionBuffer.IsCloser(1.f, 0.f));
+    }
+
+    // Overdraw is measured against the pixels covered in the final depth buffer
+    void CountVisiblePixels(FrameState& frame)
+    {
+        const DepthBuffer& ZBuffer = frame.rasterizer.ZBuffer;
+        uint64_t visible = 0;
+        for (uint32_t y = 0; y != ZBuffer.GetHeight(); ++y)
+            for (uint32_t x = 0; x != ZBuffer.GetWidth(); ++x)
+                if (ZBuffer.Get(x, y) != Rasterizer::zBufferDefault)
+                    ++visible;
+        frame.rasterizer.profiler.Add(Counter::PIXELS_VISIBLE, visible);
+    }
+}
+
+void Renderer::RenderFrame(const Loader& loader, Rasterizer& rasterizer, Image& image, FrameHistory* history)
+{
+    std::vector<DrawItem> drawItems;
+    glm::mat4 viewxprojection = SetupDraws(loader, rasterizer, drawItems);
+    FrameState frame(loader, rasterizer, image, history, viewxprojection, std::move(drawItems));
+
+    KeepHistory(frame);
+    ClearBuffers(frame);
+    
+    // If this is test on transforms, then do not need to iterate over the meshes
+    if (loader.GetType() == TestType::TRANSFORM_TEST)
+    {
+        TransformTest(frame);
+        return;
+    }
+
+    CullAndSort(frame);
+    DrawPass(frame);
+    if (frame.recordVisible && !frame.earlyZ)
+        RecordVisibleDraws(frame);
+    if (frame.earlyZ)
+        EarlyZShadePass(frame);
+    if (loader.GetType() == TestType::SHADING && loader.GetAmbientOcclusion().enabled)
+        AmbientOcclusionPass(frame);
+    if (!frame.translucent.empty())
+        TransparencyPass(frame);
+    if (rasterizer.profiler.Enabled() && rasterizer.ZBuffer.GetWidth() > 0 && frame.depthTask)
+        CountVisiblePixels(frame);
+}
+
+void Renderer::RenderProgressive(const Loader& loader, Rasterizer& rasterizer, Image& image, FrameHistory& history,
+    const StageCallback& stage)
+{
+    const bool recordVisible = history.recordVisible;
+    history.recordVisible = true;
+    for (uint32_t divisor : { 8u, 4u, 2u })
+    {
+        // rounded up, so that even a tiny preview has a pixel
+        Loader stageLoader = loader;
+        stageLoader.SetResolution((loader.GetWidth() + divisor - 1) / divisor, (loader.GetHeight() + divisor - 1) / divisor);
+        stageLoader.SetOutputName(loader.GetOutputName() + "_1of" + std::to_string(divisor));
+
+        Image stageImage(stageLoader.GetWidth(), stageLoader.GetHeight(), stageLoader.GetOutputName());
+        Rasterizer stageRasterizer(stageLoader);
+        {
+            Profiler::Scope scope(rasterizer.profiler, "preview");
+            this->RenderFrame(stageLoader, stageRasterizer, stageImage, &history);
+        }
+        stage(stageImage, stageRasterizer.ZBuffer, divisor);
+    }
+
+    history.recordVisible = recordVisible;
+    this->RenderFrame(loader, rasterizer, image, &history);
+    stage(image, rasterizer.ZBuffer, 1);
+}
+
+void Renderer::RenderAnimation(Loader& loader, Rasterizer& rasterizer, Image& image)
+{
+    const AnimationConfig& animation = loader.GetAnimation();
+    const std::string baseName = loader.GetOutputName();
+
+    // At most one frame is being encoded while the next one is rasterized; the encoder
+    //   works on its own copy so the shared buffers can be reused right away
+    std::future<void> pendingWrite;
+    Profiler& profiler = rasterizer.profiler;
+    auto writeFrame = [&](auto& buffer, const std::string& name)
+    {
+        buffer.SetFilename(name);
+        if (!animation.pipelineWrite)
+        {
+            Profiler::Scope scope(profiler, "write");
+            buffer.Write();
+            return;
+        }
+        if (pendingWrite.valid())
+            pendingWrite.get();
+        pendingWrite = std::async(std::launch::async, [copy = buffer, &profiler]() mutable
+        {
+            Profiler::Scope scope(profiler, "write");
+            copy.Write();
+        });
+    };
+
+    // keyframes only change the camera and transforms, so frames where the camera holds still redraw what moved
+    FrameHistory history;
+    for (uint32_t frame = 0; frame != animation.frames; ++frame)
+    {
+        loader.ApplyKeyframe(frame);
+        this->RenderFrame(loader, rasterizer, image, &history);
+
+        std::string index = std::to_string(frame);
+        std::string name = baseName + "_" + std::string(index.size() < 4 ? 4 - index.size() : 0, '0') + index;
         if (loader.GetType() == TestType::SHADING_DEPTH)
-            rasterizer.ZBuffer.Write();
-        else if (loader.GetType() != TestType::TRANSFORM_TEST)
-            image.Write();
+            writeFrame(rasterizer.ZBuffer, name);
+        else
+            writeFrame(image, name);
     }
+
+    if (pendingWrite.valid())
+        pendingWrite.get();
 }
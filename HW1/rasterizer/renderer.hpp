@@ -5,6 +5,43 @@
 #include "rasterizer.hpp"
 #include "loader.hpp"
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// One draw of a shape of the loaded model. `model` indexes `Rasterizer::model`; NO_MODEL (or any index
+//   the rasterizer did not fill) draws the shape untransformed
+struct DrawItem
+{
+    static constexpr size_t NO_MODEL = SIZE_MAX;
+
+    size_t shape;
+    size_t model;
+    size_t index = 0;                   // position in the draw list before culling and sorting
+};
+
+// What a frame drew, so that the next frame can draw again only where it differs. Kept by the caller between
+//   frames rendered into the same image and rasterizer; it must be invalidated when anything other than the model
+//   transforms changes, such as the lights or the config, or when the buffers are written by someone else. Pixels
+//   are only kept from a frame of the same resolution, so stages of another size can share a history
+struct FrameHistory
+{
+    bool valid = false;
+    glm::mat4 screen;                   // screenspace * projection * view of the frame
+    uint32_t width = 0, height = 0;     // of the image and depth of the frame
+    std::vector<DrawItem> drawItems;    // in submission order, before culling and sorting
+    std::vector<glm::mat4> models;      // model matrix of every draw
+    std::vector<PixelRect> rects;       // screen rectangle of every draw, see ScreenRect
+
+    // With `recordVisible`, the draws owning a pixel of the final depth are recorded in `visible`. A frame of the
+    //   same draws from another view draws those first, as occluders, and skips the others hidden behind them
+    bool recordVisible = false;
+    std::vector<uint8_t> visible;       // per draw; empty if not recorded
+};
+
 class Renderer
 {
 public:
@@ -12,7 +49,32 @@ public:
 
     void Render(int argc, char** argv);      // main render call
 
+    // Load and render a single config. Meshes are taken from `cache` when provided, and `outputName`
+    //   overrides the output entry of the config. Returns false if the config or model fails to load
+    bool RenderConfig(const std::string& yamlConfigName, AssetCache* cache = nullptr,
+        std::optional<std::string> outputName = std::nullopt);
+
+    // Render one frame of the loaded scene into `image`/`rasterizer.ZBuffer`, reusing both buffers. Nothing is
+    //   written to disk, so it also serves scenes set up in memory (see scene.hpp). With a valid `history` of the
+    //   same view and draws, only the pixels of draws whose model matrix changed are drawn again; the history is
+    //   then updated to this frame
+    void RenderFrame(const Loader& loader, Rasterizer& rasterizer, Image& image, FrameHistory* history = nullptr);
+
+    // Called with the image and depth of every stage of a progressive render, and the divisor of its resolution
+    using StageCallback = std::function<void(Image& image, DepthBuffer& depth, uint32_t divisor)>;
+
+    // Render the frame at 1/8, 1/4 and 1/2 of the resolution of `loader` and then at full resolution into
+    //   `image`/`rasterizer.ZBuffer`, handing each stage to `stage` as soon as it is done. The previews use buffers
+    //   of their own, named after the output with a `_1of<divisor>` suffix, and each stage seeds the occlusion test
+    //   of the next one with the draws it found visible. `history` ends up as after `RenderFrame` at full resolution
+    void RenderProgressive(const Loader& loader, Rasterizer& rasterizer, Image& image, FrameHistory& history,
+        const StageCallback& stage);
+
 private:
+
+    // Render every frame of the animation described in the config, loading the scene only once
+    void RenderAnimation(Loader& loader, Rasterizer& rasterizer, Image& image);
+
     std::string configName;
 };
 
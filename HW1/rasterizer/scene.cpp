@@ -0,0 +1,94 @@
+#include "scene.hpp"
+
+#include <algorithm>
+
+SceneRenderer::SceneRenderer(const std::vector<SceneMesh>& meshes) :
+    SceneRenderer(Loader::BuildMesh(meshes))
+{
+}
+
+SceneRenderer::SceneRenderer(std::shared_ptr<const MeshData> mesh) :
+    mesh(mesh),
+    renderer("<memory>")
+{
+}
+
+namespace
+{
+    bool SameColor(const Color& a, const Color& b)
+    {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+
+    // Whether `a` and `b` differ in transforms only, which FrameHistory can redraw in part
+    bool SameExceptTransforms(const SceneView& a, const SceneView& b)
+    {
+        auto sameCamera = [](const Camera& x, const Camera& y)
+        {
+            return x.pos == y.pos && x.lookAt == y.lookAt && x.up == y.up && x.width == y.width && x.height == y.height &&
+                x.nearClip == y.nearClip && x.farClip == y.farClip;
+        };
+        auto sameLight = [](const Light& x, const Light& y)
+        {
+            return x.pos == y.pos && x.intensity == y.intensity && SameColor(x.color, y.color);
+        };
+        auto sameOptions = [](const SceneOptions& x, const SceneOptions& y)
+        {
+            return x.culling == y.culling && x.sort == y.sort && x.earlyZ == y.earlyZ && x.fixedPoint == y.fixedPoint &&
+                x.traversal == y.traversal && x.depthFormat == y.depthFormat &&
+                x.occlusion.enabled == y.occlusion.enabled && x.occlusion.occluderArea == y.occlusion.occluderArea &&
+                x.ssao.enabled == y.ssao.enabled && x.ssao.radius == y.ssao.radius && x.ssao.samples == y.ssao.samples &&
+                x.ssao.intensity == y.ssao.intensity;
+        };
+
+        if (a.type != b.type || a.width != b.width || a.height != b.height || !sameCamera(a.camera, b.camera) ||
+            a.specularExponent != b.specularExponent || !SameColor(a.ambientColor, b.ambientColor) ||
+            !sameOptions(a.options, b.options) || a.lights.size() != b.lights.size())
+            return false;
+        for (size_t i = 0; i != a.lights.size(); ++i)
+            if (!sameLight(a.lights[i], b.lights[i]))
+                return false;
+        return true;
+    }
+}
+
+bool SceneRenderer::Prepare(const SceneView& view)
+{
+    if (!this->lastView.has_value() || !SameExceptTransforms(this->lastView.value(), view))
+        this->history.valid = false;
+    this->lastView.reset();
+    if (!this->mesh || !this->loader.Load(view, this->mesh))
+        return false;
+
+    if (!this->image || this->image->GetWidth() != std::min(view.width, 2000u) ||
+        this->image->GetHeight() != std::min(view.height, 2000u))
+    {
+        // the rasterizer sizes its buffers from the loader when it is constructed
+        this->rasterizer = std::make_unique<Rasterizer>(this->loader);
+        this->image = std::make_unique<Image>(view.width, view.height);
+        this->history.valid = false;
+    }
+    return true;
+}
+
+const Color* SceneRenderer::Render(const SceneView& view)
+{
+    if (!this->Prepare(view))
+        return nullptr;
+    this->renderer.RenderFrame(this->loader, *this->rasterizer, *this->image, &this->history);
+    this->lastView = view;
+    return this->image->Data();
+}
+
+bool SceneRenderer::RenderProgressive(const SceneView& view, const StageCallback& stage)
+{
+    if (!this->Prepare(view))
+        return false;
+    this->renderer.RenderProgressive(this->loader, *this->rasterizer, *this->image, this->history,
+        [&](Image& image, DepthBuffer&, uint32_t divisor)
+        {
+            stage(image.Data(), image.GetWidth(), image.GetHeight(), divisor);
+        });
+    this->lastView = view;
+    return true;
+}
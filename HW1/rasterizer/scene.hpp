@@ -0,0 +1,114 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "depthbuffer.hpp"
+#include "entities.hpp"
+#include "image.hpp"
+#include "loader.hpp"
+#include "raster.hpp"
+#include "rasterizer.hpp"
+#include "renderer.hpp"
+
+// Rendering without files: geometry, transforms, camera and lights are handed over in memory, and the frame is
+//   returned as a pointer to the pixels. The geometry is indexed once and stays resident across renders
+
+// One shape given as flat arrays. Every index refers to the same entry of all the given attributes
+struct SceneMesh
+{
+    std::string name;                   // shape name, as used by `InstanceGroup::shapeName`
+    std::vector<float> positions;       // x, y, z per vertex
+    std::vector<float> normals;         // x, y, z per vertex, or empty
+    std::vector<float> uvs;             // u, v per vertex, or empty
+    std::vector<uint32_t> indices;      // 3 per triangle
+};
+
+// Render switches with the meaning and defaults of the config entries of the same names, but for `ssao.threads`
+struct SceneOptions
+{
+    bool culling = false;
+    bool sort = false;
+    bool earlyZ = false;
+    bool fixedPoint = false;
+    Traversal traversal = Traversal::BOX;
+    DepthFormat depthFormat = DepthFormat::FLOAT;
+    OcclusionConfig occlusion;
+    // contexts are meant to run one per thread of a pool already, so the pass keeps to the calling thread unless
+    //   `ssao.threads` asks for more
+    AmbientOcclusionConfig ssao = []() { AmbientOcclusionConfig config; config.threads = 1; return config; }();
+};
+
+// Everything a config gives besides the model
+struct SceneView
+{
+    TestType type = TestType::SHADING;  // TRANSFORM, SHADING_DEPTH or SHADING
+    uint32_t width = 0;
+    uint32_t height = 0;
+    Camera camera;
+    std::vector<MeshTransform> transforms;  // one per mesh, in the order the meshes were given
+    std::vector<InstanceGroup> instances;
+    std::vector<Light> lights;
+    float specularExponent = 1.f;
+    Color ambientColor;
+    SceneOptions options;
+};
+
+// One render context: the resident geometry, and the loader, rasterizer and image a render writes to. Contexts
+//   share no mutable state, so each thread of a pool can render with its own context, while the geometry itself
+//   is shared between all of them
+class SceneRenderer
+{
+public:
+    // Index `meshes`, one shape each. On malformed input the error is printed and `IsValid()` is false
+    SceneRenderer(const std::vector<SceneMesh>& meshes);
+
+    // Render the geometry of another context (see `GetMesh`) without indexing it again
+    SceneRenderer(std::shared_ptr<const MeshData> mesh);
+
+    // The rasterizer keeps a reference to the loader
+    SceneRenderer(const SceneRenderer&) = delete;
+    SceneRenderer& operator= (const SceneRenderer&) = delete;
+
+    inline bool IsValid() const { return this->mesh != nullptr; }
+    inline const std::shared_ptr<const MeshData>& GetMesh() const { return this->mesh; }
+
+    // Render `view` and return `GetWidth() * GetHeight()` RGBA colors, row by row from the bottom row up. The
+    //   buffers are reused while the resolution stays the same, and the pointer is valid until the next call.
+    //   Returns nullptr if the view is invalid. SHADING_DEPTH leaves the colors black; read `GetDepth()` instead.
+    //   If only the transforms differ from the previous view, only the pixels of the draws that moved are drawn
+    //   again (see FrameHistory)
+    const Color* Render(const SceneView& view);
+
+    // Called with the colors of a stage of a progressive render, laid out as by `Render`, and the divisor of its
+    //   resolution. The pointer is only valid during the call
+    using StageCallback = std::function<void(const Color* pixels, uint32_t width, uint32_t height, uint32_t divisor)>;
+
+    // Render `view` as `Render` does, but first at 1/8, 1/4 and 1/2 of its resolution, handing every stage to
+    //   `stage` (see Renderer::RenderProgressive). Returns false if the view is invalid
+    bool RenderProgressive(const SceneView& view, const StageCallback& stage);
+
+    // Valid after a successful render
+    inline const DepthBuffer& GetDepth() const { return this->rasterizer->ZBuffer; }
+    inline uint32_t GetWidth() const { return this->image ? this->image->GetWidth() : 0; }
+    inline uint32_t GetHeight() const { return this->image ? this->image->GetHeight() : 0; }
+
+private:
+    // Load `view` and size the buffers for it
+    bool Prepare(const SceneView& view);
+
+    std::shared_ptr<const MeshData> mesh;
+    Loader loader;
+    Renderer renderer;
+    std::unique_ptr<Rasterizer> rasterizer;     // rebuilt when the resolution changes
+    std::unique_ptr<Image> image;
+    FrameHistory history;
+    std::optional<SceneView> lastView;          // of the frame in `history`
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include "simplify.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "../thirdparty/glm/glm.hpp"
+
+namespace
+{
+    // Symmetric 4x4 matrix stored as its upper triangle: the sum of squared distances to a set of planes
+    struct Quadric
+    {
+        std::array<double, 10> q{};
+
+        static Quadric FromPlane(glm::dvec3 n, double d, double weight = 1.0)
+        {
+            Quadric result;
+            double a = n.x, b = n.y, c = n.z;
+            result.q = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+            for (double& v : result.q)
+                v *= weight;
+            return result;
+        }
+
+        Quadric& operator+= (const Quadric& other)
+        {
+            for (size_t i = 0; i != this->q.size(); ++i)
+                this->q[i] += other.q[i];
+            return *this;
+        }
+
+        double Error(glm::dvec3 p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+                + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+                + q[7] * z * z + 2 * q[8] * z + q[9];
+        }
+    };
+
+    struct Face
+    {
+        std::array<uint32_t, 3> v;                  // local vertex ids
+        std::array<tinyobj::index_t, 3> corner;     // attributes of the corners
+        int material;
+        bool alive;
+    };
+
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to;                          // `from` is merged into `to`
+        uint32_t fromVersion, toVersion;
+
+        bool operator< (const Collapse& other) const { return this->cost > other.cost; }
+    };
+
+    // boundary planes dominate interior ones so that open borders do not shrink
+    constexpr double BOUNDARY_WEIGHT = 100.0;
+}
+
+SimplifiedShape SimplifyShape(const tinyobj::attrib_t& attribs, const tinyobj::shape_t& shape, size_t targetFaces)
+{
+    // Local vertex ids for the vertices used by the shape
+    std::unordered_map<int, uint32_t> localOf;
+    std::vector<int> globalOf;
+    std::vector<glm::dvec3> position;
+    std::vector<Face> faces;
+    faces.reserve(shape.mesh.num_face_vertices.size());
+    for (size_t f = 0; f != shape.mesh.num_face_vertices.size(); ++f)
+    {
+        Face face;
+        for (size_t c = 0; c != 3; ++c)
+        {
+            const tinyobj::index_t& idx = shape.mesh.indices[3 * f + c];
+            auto [it, inserted] = localOf.emplace(idx.vertex_index, static_cast<uint32_t>(globalOf.size()));
+            if (inserted)
+            {
+                globalOf.push_back(idx.vertex_index);
+                const tinyobj::real_t* p = &attribs.vertices[3 * size_t(idx.vertex_index)];
+                position.emplace_back(p[0], p[1], p[2]);
+            }
+            face.v[c] = it->second;
+            face.corner[c] = idx;
+        }
+        face.material = f < shape.mesh.material_ids.size() ? shape.mesh.material_ids[f] : -1;
+        face.alive = face.v[0] != face.v[1] && face.v[1] != face.v[2] && face.v[0] != face.v[2];
+        faces.push_back(face);
+    }
+
+    const size_t vertexCount = globalOf.size();
+    std::vector<Quadric> quadric(vertexCount);
+    std::vector<std::vector<uint32_t>> adjacent(vertexCount);
+    std::vector<uint32_t> version(vertexCount, 0);
+    std::vector<bool> removed(vertexCount, false);
+
+    // Input planes of the faces every vertex stands for: the error of the result is measured against these
+    //   rather than the quadrics, which are squared, summed and weighted on the boundary
+    std::vector<glm::dvec4> facePlane(faces.size(), glm::dvec4(0.0));
+    std::vector<std::vector<uint32_t>> planesOf(vertexCount);
+
+    auto normalOf = [&](const Face& face, uint32_t moved, glm::dvec3 to)
+    {
+        glm::dvec3 p[3];
+        for (size_t c = 0; c != 3; ++c)
+            p[c] = face.v[c] == moved ? to : position[face.v[c]];
+        return glm::cross(p[1] - p[0], p[2] - p[0]);
+    };
+
+    // Face quadrics, and counts of the faces on every edge to find the boundary
+    std::unordered_map<uint64_t, uint32_t> edgeFaces;
+    auto edgeKey = [](uint32_t a, uint32_t b) { return (uint64_t(std::min(a, b)) << 32) | std::max(a, b); };
+    size_t aliveFaces = 0;
+    for (uint32_t f = 0; f != faces.size(); ++f)
+    {
+        const Face& face = faces[f];
+        if (!face.alive)
+            continue;
+        ++aliveFaces;
+        glm::dvec3 n = normalOf(face, UINT32_MAX, glm::dvec3());
+        double length = glm::length(n);
+        if (length > 0.0)
+        {
+            n /= length;
+            Quadric plane = Quadric::FromPlane(n, -glm::dot(n, position[face.v[0]]));
+            facePlane[f] = glm::dvec4(n, -glm::dot(n, position[face.v[0]]));
+            for (uint32_t v : face.v)
+            {
+                quadric[v] += plane;
+                planesOf[v].push_back(f);
+            }
+        }
+        for (size_t c = 0; c != 3; ++c)
+        {
+            adjacent[face.v[c]].push_back(f);
+            ++edgeFaces[edgeKey(face.v[c], face.v[(c + 1) % 3])];
+        }
+    }
+    for (const Face& face : faces)
+    {
+        if (!face.alive)
+            continue;
+        glm::dvec3 n = normalOf(face, UINT32_MAX, glm::dvec3());
+        for (size_t c = 0; c != 3; ++c)
+        {
+            uint32_t a = face.v[c], b = face.v[(c + 1) % 3];
+            if (edgeFaces[edgeKey(a, b)] != 1)
+                continue;
+            glm::dvec3 side = glm::cross(position[b] - position[a], n);
+            double length = glm::length(side);
+            if (length == 0.0)
+                continue;
+            side /= length;
+            Quadric plane = Quadric::FromPlane(side, -glm::dot(side, position[a]), BOUNDARY_WEIGHT);
+            quadric[a] += plane;
+            quadric[b] += plane;
+        }
+    }
+
+    // Both directions of an edge are candidates; the cheaper one is popped first
+    std::priority_queue<Collapse> heap;
+    auto pushEdge = [&](uint32_t a, uint32_t b)
+    {
+        Quadric sum = quadric[a];
+        sum += quadric[b];
+        heap.push({ sum.Error(position[b]), a, b, version[a], version[b] });
+        heap.push({ sum.Error(position[a]), b, a, version[b], version[a] });
+    };
+    for (const auto& [key, count] : edgeFaces)
+        pushEdge(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key & 0xffffffffu));
+
+    SimplifiedShape result;
+    double maxDistance = 0.0;
+    std::vector<uint32_t> neighbours;
+    while (aliveFaces > targetFaces && !heap.empty())
+    {
+        Collapse collapse = heap.top();
+        heap.pop();
+        uint32_t from = collapse.from, to = collapse.to;
+        if (removed[from] || removed[to] || version[from] != collapse.fromVersion || version[to] != collapse.toVersion)
+            continue;
+
+        // Reject collapses that flip (or degenerate) a face that survives the collapse
+        bool flips = false;
+        for (uint32_t f : adjacent[from])
+        {
+            const Face& face = faces[f];
+            if (!face.alive || face.v[0] == to || face.v[1] == to || face.v[2] == to)
+                continue;
+            glm::dvec3 before = normalOf(face, UINT32_MAX, glm::dvec3());
+            glm::dvec3 after = normalOf(face, from, position[to]);
+            if (glm::dot(before, after) <= 0.0)
+            {
+                flips = true;
+                break;
+            }
+        }
+        if (flips)
+            continue;
+
+        // `to` does not move, so only its distance to the planes `from` stood for is new
+        for (uint32_t f : planesOf[from])
+            maxDistance = std::max(maxDistance, std::abs(glm::dot(glm::dvec3(facePlane[f]), position[to]) + facePlane[f].w));
+        auto& planes = planesOf[to];
+        planes.insert(planes.end(), planesOf[from].begin(), planesOf[from].end());
+        std::sort(planes.begin(), planes.end());
+        planes.erase(std::unique(planes.begin(), planes.end()), planes.end());
+        planesOf[from].clear();
+
+        // Merge `from` into `to`; corners of `from` keep their own normal and uv
+        neighbours.clear();
+        for (uint32_t f : adjacent[from])
+        {
+            Face& face = faces[f];
+            if (!face.alive)
+                continue;
+            if (face.v[0] == to || face.v[1] == to || face.v[2] == to)
+            {
+                face.alive = false;
+                --aliveFaces;
+                continue;
+            }
+            for (size_t c = 0; c != 3; ++c)
+            {
+                if (face.v[c] == from)
+                {
+                    face.v[c] = to;
+                    face.corner[c].vertex_index = globalOf[to];
+                }
+                else
+                    neighbours.push_back(face.v[c]);
+            }
+            adjacent[to].push_back(f);
+        }
+        removed[from] = true;
+        adjacent[from].clear();
+        quadric[to] += quadric[from];
+        ++version[to];
+
+        // drop dead faces from the survivor, then re-queue its edges
+        auto& list = adjacent[to];
+        list.erase(std::remove_if(list.begin(), list.end(), [&faces](uint32_t f) { return !faces[f].alive; }), list.end());
+        for (uint32_t f : list)
+            for (uint32_t v : faces[f].v)
+                if (v != to)
+                    neighbours.push_back(v);
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (uint32_t v : neighbours)
+            pushEdge(to, v);
+    }
+
+    result.shape.name = shape.name;
+    tinyobj::mesh_t& mesh = result.shape.mesh;
+    mesh.indices.reserve(3 * aliveFaces);
+    for (const Face& face : faces)
+    {
+        if (!face.alive)
+            continue;
+        mesh.indices.insert(mesh.indices.end(), face.corner.begin(), face.corner.end());
+        mesh.num_face_vertices.push_back(3);
+        mesh.material_ids.push_back(face.material);
+        mesh.smoothing_group_ids.push_back(0);
+    }
+    result.error = static_cast<float>(maxDistance);
+    return result;
+}
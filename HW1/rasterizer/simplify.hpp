@@ -0,0 +1,24 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <cstddef>
+
+#include "../thirdparty/tinyobj/tiny_obj_fwd.h"
+
+// Quadric error metric edge-collapse simplification (Garland & Heckbert 1997) of triangulated shapes.
+//   Every collapse merges one vertex into the other endpoint of the edge, so the simplified shape
+//   references a subset of the original vertex indices and needs no new vertex data
+
+struct SimplifiedShape
+{
+    tinyobj::shape_t shape;
+    // Largest distance (object space) from a kept vertex to the plane of any input face it replaced: how far
+    //   the surface moved at the vertices, while the inside of the faces is not measured
+    float error = 0.f;
+};
+
+// Collapse edges of `shape` in order of increasing error until at most `targetFaces` faces remain, or
+//   no collapse is possible without flipping a face. Boundary edges are kept in place by penalty planes
+SimplifiedShape SimplifyShape(const tinyobj::attrib_t& attribs, const tinyobj::shape_t& shape, size_t targetFaces);
+
+#endif
@@ -0,0 +1,339 @@
+#include "ssao.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr float PI = 3.14159265358979f;
+    constexpr float SPIRAL_TURNS = 7.f;         // turns of the sample spiral around a pixel
+    constexpr float NORMAL_BIAS = 0.1f;         // cosine below which a sample does not occlude, against self-occlusion
+    constexpr float DEPTH_TOLERANCE = 0.05f;    // relative difference of w beyond which the filters ignore a pixel
+
+    // Weight of a pixel at `w` in a filter around a pixel at `center`; 0 across a depth discontinuity
+    inline float DepthWeight(float w, float center)
+    {
+        return std::max(0.f, 1.f - std::abs(w - center) / (DEPTH_TOLERANCE * center));
+    }
+}
+
+RowWorkers::RowWorkers(uint32_t threads)
+{
+    for (uint32_t band = 1; band < threads; ++band)
+        this->workers.emplace_back(&RowWorkers::Work, this, band);
+}
+
+RowWorkers::~RowWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stop = true;
+    }
+    this->wake.notify_all();
+    for (std::thread& worker : this->workers)
+        worker.join();
+}
+
+void RowWorkers::Run(uint32_t rows, const std::function<void(uint32_t, uint32_t)>& body)
+{
+    // a band of a few rows is not worth a thread
+    uint32_t bands = std::clamp(rows / 16, 1u, this->Threads());
+    if (bands == 1)
+    {
+        body(0, rows);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->body = &body;
+        this->rows = rows;
+        this->bands = bands;
+        this->pending = bands - 1;
+        ++this->pass;
+    }
+    this->wake.notify_all();
+    body(0, rows / bands);
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->done.wait(lock, [this]() { return this->pending == 0; });
+}
+
+void RowWorkers::Work(uint32_t band)
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true)
+    {
+        this->wake.wait(lock, [&]() { return this->stop || this->pass != seen; });
+        if (this->stop)
+            return;
+        seen = this->pass;
+        if (band >= this->bands)
+            continue;
+
+        const std::function<void(uint32_t, uint32_t)>& body = *this->body;
+        uint32_t first = this->rows * band / this->bands, last = this->rows * (band + 1) / this->bands;
+        lock.unlock();
+        body(first, last);
+        lock.lock();
+        if (--this->pending == 0)
+            this->done.notify_one();
+    }
+}
+
+bool AmbientOcclusion::SetView(const glm::mat4& screen, const Camera& camera, float clearDepth)
+{
+    this->b = 0.f;
+    this->eye = camera.pos;
+    this->clearDepth = clearDepth;
+
+    glm::vec3 forward = glm::normalize(camera.lookAt - camera.pos);
+    glm::vec4 nearPoint = screen * glm::vec4(camera.pos + camera.nearClip * forward, 1.f);
+    glm::vec4 farPoint = screen * glm::vec4(camera.pos + camera.farClip * forward, 1.f);
+    if (!(nearPoint.w > 0.f && farPoint.w > nearPoint.w))
+        return false;
+
+    // rows x, y and w of `screen` give sx * w, sy * w and w as linear functions of the point
+    const int sources[3] = { 0, 1, 3 };
+    glm::mat3 rows;
+    glm::vec3 offsets;
+    for (int row = 0; row != 3; ++row)
+    {
+        rows[0][row] = screen[0][sources[row]];
+        rows[1][row] = screen[1][sources[row]];
+        rows[2][row] = screen[2][sources[row]];
+        offsets[row] = screen[3][sources[row]];
+    }
+    if (glm::determinant(rows) == 0.f)
+        return false;
+    this->unproject = glm::inverse(rows);
+    this->origin = this->unproject * offsets;
+
+    // fit depth = a + b / w through the clip planes
+    float nearDepth = nearPoint.z / nearPoint.w, farDepth = farPoint.z / farPoint.w;
+    this->b = (nearDepth - farDepth) / (1.f / nearPoint.w - 1.f / farPoint.w);
+    this->a = nearDepth - this->b / nearPoint.w;
+
+    glm::vec3 right = glm::normalize(glm::cross(forward, camera.up));
+    glm::vec3 up = glm::cross(right, forward);
+    this->pixelScale = 0.25f * (std::abs(glm::dot(glm::vec3(rows[0][0], rows[1][0], rows[2][0]), right)) +
+        std::abs(glm::dot(glm::vec3(rows[0][1], rows[1][1], rows[2][1]), up)));
+    return this->b != 0.f;
+}
+
+void AmbientOcclusion::Apply(const DepthBuffer& ZBuffer, Image& image, const AmbientOcclusionConfig& config)
+{
+    if (this->b == 0.f || config.samples == 0 || ZBuffer.GetWidth() != image.GetWidth() ||
+        ZBuffer.GetHeight() != image.GetHeight() || ZBuffer.GetWidth() == 0 || ZBuffer.GetHeight() == 0)
+        return;
+
+    uint32_t threads = config.threads > 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    if (threads == 1)
+        this->workers.reset();
+    else if (!this->workers || this->workers->Threads() != threads)
+        this->workers = std::make_unique<RowWorkers>(threads);
+
+    this->Reconstruct(ZBuffer);
+    this->Gather(config);
+    this->Blur();
+
+    // bilateral upsample: the bilinear weights of the four nearest half-resolution pixels, each scaled down by its
+    //   difference in depth; a pixel left with no weight takes the occlusion of the first one
+    this->ForRows(ZBuffer.GetHeight(), [&](uint32_t first, uint32_t last)
+    {
+        for (uint32_t y = first; y != last; ++y)
+        {
+            uint32_t y0 = y / 2, y1 = std::min(y0 + 1, this->height - 1);
+            float ty = (y & 1) ? 0.5f : 0.f;
+            for (uint32_t x = 0; x != ZBuffer.GetWidth(); ++x)
+            {
+                uint32_t x0 = x / 2, x1 = std::min(x0 + 1, this->width - 1);
+                const size_t taps[4] = {
+                    static_cast<size_t>(y0) * this->width + x0, static_cast<size_t>(y0) * this->width + x1,
+                    static_cast<size_t>(y1) * this->width + x0, static_cast<size_t>(y1) * this->width + x1 };
+                // most pixels are not occluded at all
+                if (this->occlusion[taps[0]] == 0.f && this->occlusion[taps[1]] == 0.f &&
+                    this->occlusion[taps[2]] == 0.f && this->occlusion[taps[3]] == 0.f)
+                    continue;
+                float center = this->ClipW(ZBuffer.Get(x, y).value());
+                if (std::isinf(center))
+                    continue;
+
+                float tx = (x & 1) ? 0.5f : 0.f;
+                const float bilinear[4] = { (1.f - tx) * (1.f - ty), tx * (1.f - ty), (1.f - tx) * ty, tx * ty };
+                float sum = 0.f, total = 0.f;
+                for (int k = 0; k != 4; ++k)
+                {
+                    float weight = bilinear[k] * DepthWeight(this->points[taps[k]].w, center) + (k == 0 ? 1e-4f : 0.f);
+                    sum += weight * this->occlusion[taps[k]];
+                    total += weight;
+                }
+                float factor = 1.f - std::clamp(config.intensity * sum / total, 0.f, 1.f);
+
+                Color color = image.Get(x, y).value();
+                image.Set(x, y, Color(color.r * factor, color.g * factor, color.b * factor, color.a));
+            }
+        }
+    });
+}
+
+void AmbientOcclusion::ForRows(uint32_t rows, const std::function<void(uint32_t, uint32_t)>& body)
+{
+    if (this->workers)
+        this->workers->Run(rows, body);
+    else
+        body(0, rows);
+}
+
+void AmbientOcclusion::Reconstruct(const DepthBuffer& ZBuffer)
+{
+    this->width = (ZBuffer.GetWidth() + 1) / 2;
+    this->height = (ZBuffer.GetHeight() + 1) / 2;
+    this->points.resize(static_cast<size_t>(this->width) * this->height);
+
+    // branch-free over a row once the depth is read, so that the compiler can vectorize it
+    this->ForRows(this->height, [&](uint32_t first, uint32_t last)
+    {
+        std::vector<float> rowW(this->width);
+        for (uint32_t j = first; j != last; ++j)
+        {
+            for (uint32_t i = 0; i != this->width; ++i)
+                rowW[i] = this->ClipW(ZBuffer.Get(2 * i, 2 * j).value());
+
+            size_t row = static_cast<size_t>(j) * this->width;
+            glm::vec3 rowBase = this->unproject[1] * (2.f * static_cast<float>(j) + 0.5f) + this->unproject[2];
+            for (uint32_t i = 0; i != this->width; ++i)
+            {
+                float sx = 2.f * static_cast<float>(i) + 0.5f;
+                float clipW = rowW[i] < INFINITY ? rowW[i] : 0.f;
+                this->points[row + i] = glm::vec4(clipW * (this->unproject[0] * sx + rowBase) - this->origin, rowW[i]);
+            }
+        }
+    });
+}
+
+void AmbientOcclusion::Gather(const AmbientOcclusionConfig& config)
+{
+    this->occlusion.assign(this->points.size(), 0.f);
+
+    // unit directions and relative distances along the spiral; each pixel rotates it by its own angle, so that
+    //   neighbouring pixels sample different directions and the blur averages them
+    std::vector<glm::vec3> spiral(config.samples);
+    for (uint32_t i = 0; i != config.samples; ++i)
+    {
+        float alpha = (static_cast<float>(i) + 0.5f) / static_cast<float>(config.samples);
+        float angle = 2.f * PI * SPIRAL_TURNS * alpha;
+        spiral[i] = glm::vec3(std::cos(angle), std::sin(angle), alpha);
+    }
+    // the angles repeat every 4x4 pixels, which the blur covers
+    glm::vec2 rotations[16];
+    for (uint32_t k = 0; k != 16; ++k)
+    {
+        uint32_t i = k % 4, j = k / 4;
+        float angle = static_cast<float>((3 * i ^ j) + i * j) * 10.f;
+        rotations[k] = glm::vec2(std::cos(angle), std::sin(angle));
+    }
+
+    const float radius2 = config.radius * config.radius;
+    const float maxRadius = 0.25f * static_cast<float>(std::max(this->width, this->height));
+    auto at = [&](size_t index) { return glm::vec3(this->points[index]); };
+
+    this->ForRows(this->height, [&](uint32_t first, uint32_t last)
+    {
+        for (uint32_t j = first; j != last; ++j)
+            for (uint32_t i = 0; i != this->width; ++i)
+            {
+                size_t index = static_cast<size_t>(j) * this->width + i;
+                float center = this->points[index].w;
+                if (std::isinf(center))
+                    continue;
+                glm::vec3 p = at(index);
+
+                // the normal from the neighbours on the same surface, those closer in depth
+                auto tangent = [&](bool alongX)
+                {
+                    size_t step = alongX ? 1 : this->width;
+                    bool hasLo = alongX ? i > 0 : j > 0;
+                    bool hasHi = alongX ? i + 1 < this->width : j + 1 < this->height;
+                    float dLo = hasLo ? std::abs(this->points[index - step].w - center) : INFINITY;
+                    float dHi = hasHi ? std::abs(this->points[index + step].w - center) : INFINITY;
+                    if (std::isinf(dLo) && std::isinf(dHi))
+                        return glm::vec3(0.f);
+                    return dHi <= dLo ? at(index + step) - p : p - at(index - step);
+                };
+                glm::vec3 n = glm::cross(tangent(true), tangent(false));
+                glm::vec3 toEye = this->eye - p;
+                if (glm::dot(n, n) == 0.f)
+                    n = toEye;
+                n = glm::normalize(glm::dot(n, toEye) < 0.f ? -n : n);
+
+                glm::vec2 rotation = rotations[(j % 4) * 4 + i % 4];
+                float pixels = std::min(config.radius * this->pixelScale / center, maxRadius);
+
+                float sum = 0.f;
+                for (const glm::vec3& sample : spiral)
+                {
+                    // the pixel under the offset center, by truncation once it is known to be positive
+                    float offset = sample.z * pixels;
+                    float fx = static_cast<float>(i) + 0.5f + (rotation.x * sample.x - rotation.y * sample.y) * offset;
+                    float fy = static_cast<float>(j) + 0.5f + (rotation.y * sample.x + rotation.x * sample.y) * offset;
+                    if (!(fx >= 0.f && fy >= 0.f && fx < static_cast<float>(this->width) && fy < static_cast<float>(this->height)))
+                        continue;
+                    size_t tap = static_cast<size_t>(fy) * this->width + static_cast<size_t>(fx);
+                    if (std::isinf(this->points[tap].w))
+                        continue;
+
+                    glm::vec3 v = at(tap) - p;
+                    float v2 = glm::dot(v, v);
+                    if (v2 >= radius2 || v2 == 0.f)
+                        continue;
+                    // geometry above the tangent plane occludes, less with the distance
+                    sum += std::max(0.f, glm::dot(v, n) / std::sqrt(v2) - NORMAL_BIAS) * (1.f - v2 / radius2);
+                }
+                // scaled so that the floor of a right-angled corner loses about half of its light
+                this->occlusion[index] = 4.f * sum / static_cast<float>(config.samples);
+            }
+    });
+}
+
+void AmbientOcclusion::Blur()
+{
+    static constexpr float kernel[5] = { 1.f, 4.f, 6.f, 4.f, 1.f };
+    this->scratch.resize(this->occlusion.size());
+
+    auto pass = [&](const std::vector<float>& source, std::vector<float>& target, bool alongX)
+    {
+        this->ForRows(this->height, [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t j = first; j != last; ++j)
+                for (uint32_t i = 0; i != this->width; ++i)
+                {
+                    size_t index = static_cast<size_t>(j) * this->width + i;
+                    float center = this->points[index].w;
+                    if (std::isinf(center))
+                    {
+                        target[index] = 0.f;
+                        continue;
+                    }
+                    float sum = 0.f, total = 0.f;
+                    for (int32_t k = -2; k <= 2; ++k)
+                    {
+                        int32_t ti = static_cast<int32_t>(i) + (alongX ? k : 0);
+                        int32_t tj = static_cast<int32_t>(j) + (alongX ? 0 : k);
+                        if (ti < 0 || tj < 0 || ti >= static_cast<int32_t>(this->width) ||
+                            tj >= static_cast<int32_t>(this->height))
+                            continue;
+                        size_t tap = static_cast<size_t>(tj) * this->width + ti;
+                        float weight = kernel[k + 2] * DepthWeight(this->points[tap].w, center);
+                        sum += weight * source[tap];
+                        total += weight;
+                    }
+                    // the center tap always has full weight
+                    target[index] = sum / total;
+                }
+        });
+    };
+    pass(this->occlusion, this->scratch, true);
+    pass(this->scratch, this->occlusion, false);
+}
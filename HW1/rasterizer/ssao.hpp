@@ -0,0 +1,108 @@
+#ifndef SSAO_H
+#define SSAO_H
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "depthbuffer.hpp"
+#include "entities.hpp"
+#include "image.hpp"
+
+#include "../thirdparty/glm/glm.hpp"
+
+// Screen-space ambient occlusion from the final depth. Positions are reconstructed from the depth buffer at half
+//   resolution, normals from the positions of neighbouring pixels. Occlusion is gathered at half resolution,
+//   blurred, and brought back to full resolution by a depth-aware (bilateral) filter, so that it does not bleed
+//   across silhouettes
+
+struct AmbientOcclusionConfig
+{
+    bool enabled = false;
+    float radius = 0.5f;                // world-space distance within which geometry occludes
+    uint32_t samples = 12;              // per half-resolution pixel
+    float intensity = 1.f;              // scale of the occlusion; 0 leaves the image unchanged
+    uint32_t threads = 0;               // rows are split between this many threads; 0 uses every hardware thread
+};
+
+// Threads that take a band of rows of every pass they are given, and wait for the next pass in between. They are
+//   started once and kept across passes and frames, the calling thread taking the first band
+class RowWorkers
+{
+public:
+    RowWorkers(uint32_t threads);       // including the calling thread
+    ~RowWorkers();
+
+    RowWorkers(const RowWorkers&) = delete;
+    RowWorkers& operator= (const RowWorkers&) = delete;
+
+    inline uint32_t Threads() const { return static_cast<uint32_t>(this->workers.size()) + 1; }
+
+    // Run `body(first, last)` over bands covering `rows` rows, and return once every band is done
+    void Run(uint32_t rows, const std::function<void(uint32_t, uint32_t)>& body);
+
+private:
+    void Work(uint32_t band);
+
+    std::mutex mutex;
+    std::condition_variable wake;       // a pass was posted, or the workers should stop
+    std::condition_variable done;       // the last band of the pass finished
+    const std::function<void(uint32_t, uint32_t)>* body = nullptr;
+    uint32_t rows = 0;
+    uint32_t bands = 0;                 // of the current pass; workers beyond it sit the pass out
+    uint32_t pending = 0;               // bands of the current pass still running on the workers
+    uint64_t pass = 0;                  // incremented for every pass posted
+    bool stop = false;
+    std::vector<std::thread> workers;
+};
+
+class AmbientOcclusion
+{
+public:
+    // `screen = screenspace * projection * view`, as used for the depth, which is of the form a + b / w for a
+    //   perspective projection, reversed or not. Pixels still holding `clearDepth` have not been drawn. Returns
+    //   false, and `Apply` does nothing, for other projections
+    bool SetView(const glm::mat4& screen, const Camera& camera, float clearDepth);
+
+    // Compute the occlusion of every pixel of `ZBuffer` and darken the color of `image`, of the same size, with
+    //   it. The buffers and threads are kept for the next frame
+    void Apply(const DepthBuffer& ZBuffer, Image& image, const AmbientOcclusionConfig& config);
+
+private:
+    // Clip-space w of a depth, infinite where nothing was drawn
+    inline float ClipW(float depth) const
+    {
+        float w = this->b / (depth - this->a);
+        return depth != this->clearDepth && w > 0.f ? w : INFINITY;
+    }
+
+    // Run `body(first, last)` over `rows` rows, split between the workers if there are any
+    void ForRows(uint32_t rows, const std::function<void(uint32_t, uint32_t)>& body);
+
+    // Positions of the half-resolution pixels, each taken at the top-left pixel of its 2x2 block
+    void Reconstruct(const DepthBuffer& ZBuffer);
+    // Occlusion of the half-resolution pixels
+    void Gather(const AmbientOcclusionConfig& config);
+    // Depth-aware 5-tap blur at half resolution, along x then along y
+    void Blur();
+
+    float a = 0.f, b = 0.f;             // depth = a + b / w
+    glm::mat3 unproject;                // (sx, sy, 1) to the world-space direction whose multiple by w is the point
+    glm::vec3 origin;                   // subtracted from that multiple
+    glm::vec3 eye;
+    float pixelScale = 0.f;             // half-resolution pixels covered by a unit distance at w = 1
+    float clearDepth = 0.f;
+
+    uint32_t width = 0, height = 0;     // of the half-resolution buffers
+    std::vector<glm::vec4> points;      // position and w, infinite where nothing was drawn; together, so that a
+                                        //   sample reads a single cache line
+    std::vector<float> occlusion, scratch;
+    std::unique_ptr<RowWorkers> workers;    // none while a single thread is asked for
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// implementation is compiled into image.cpp
+#include "../thirdparty/stb/stb_image.h"
+
+namespace
+{
+    // Spread the 3 low bits of v over the even bit positions: b2 b1 b0 -> b2 0 b1 0 b0
+    inline uint32_t SpreadBits3(uint32_t v)
+    {
+        return (v & 1u) | ((v & 2u) << 1) | ((v & 4u) << 2);
+    }
+
+    inline glm::vec4 ToVec4(const Color& c)
+    {
+        return glm::vec4(c.r, c.g, c.b, c.a) * (1.f / 255.f);
+    }
+
+    inline int32_t Wrap(int32_t v, uint32_t size)
+    {
+        int32_t s = static_cast<int32_t>(size);
+        int32_t r = v % s;
+        return r < 0 ? r + s : r;
+    }
+}
+
+Texture::Texture(std::string filename) : filename(filename) {  }
+
+bool Texture::Load()
+{
+    int w, h, channels;
+    unsigned char* data = stbi_load(this->filename.c_str(), &w, &h, &channels, 4);
+    if (!data)
+    {
+        std::cerr << "[WARNING] failed to load texture " << this->filename << ": " << stbi_failure_reason() << std::endl;
+        this->levels.clear();
+        return false;
+    }
+
+    // Color is laid out as 4 consecutive bytes, the same as an RGBA8 stb buffer
+    this->FromPixels(static_cast<uint32_t>(w), static_cast<uint32_t>(h), reinterpret_cast<const Color*>(data));
+    stbi_image_free(data);
+    return true;
+}
+
+void Texture::FromPixels(uint32_t width, uint32_t height, const Color* pixels)
+{
+    this->levels.clear();
+    if (width == 0 || height == 0)
+        return;
+
+    MipLevel base = MakeLevel(width, height);
+    // images are stored top row first while uv has v pointing up; flip while tiling
+    for (uint32_t y = 0; y != height; ++y)
+        for (uint32_t x = 0; x != width; ++x)
+            base.texels[TexelIndex(base, x, y)] = pixels[static_cast<size_t>(height - 1 - y) * width + x];
+
+    this->levels.push_back(std::move(base));
+    this->GenerateMips();
+}
+
+Texture::MipLevel Texture::MakeLevel(uint32_t width, uint32_t height)
+{
+    MipLevel level;
+    level.width = width;
+    level.height = height;
+    level.tilesX = (width + TILE_SIZE - 1) >> TILE_BITS;
+    uint32_t tilesY = (height + TILE_SIZE - 1) >> TILE_BITS;
+    level.texels.resize(static_cast<size_t>(level.tilesX) * tilesY * TILE_SIZE * TILE_SIZE);
+    return level;
+}
+
+size_t Texture::TexelIndex(const MipLevel& level, uint32_t x, uint32_t y)
+{
+    size_t tile = static_cast<size_t>(y >> TILE_BITS) * level.tilesX + (x >> TILE_BITS);
+    uint32_t inner = SpreadBits3(x & (TILE_SIZE - 1)) | (SpreadBits3(y & (TILE_SIZE - 1)) << 1);
+    return (tile << (2 * TILE_BITS)) + inner;
+}
+
+void Texture::GenerateMips()
+{
+    // 2x2 box filter; odd sizes clamp the last row/column
+    while (this->levels.back().width > 1 || this->levels.back().height > 1)
+    {
+        const MipLevel& src = this->levels.back();
+        MipLevel dst = MakeLevel(std::max(1u, src.width / 2), std::max(1u, src.height / 2));
+
+        for (uint32_t y = 0; y != dst.height; ++y)
+        {
+            uint32_t y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+            for (uint32_t x = 0; x != dst.width; ++x)
+            {
+                uint32_t x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                glm::vec4 sum = ToVec4(src.texels[TexelIndex(src, x0, y0)]) +
+                    ToVec4(src.texels[TexelIndex(src, x1, y0)]) +
+                    ToVec4(src.texels[TexelIndex(src, x0, y1)]) +
+                    ToVec4(src.texels[TexelIndex(src, x1, y1)]);
+                glm::vec4 avg = sum * (255.f / 4.f) + 0.5f;
+                dst.texels[TexelIndex(dst, x, y)] = Color(avg);
+            }
+        }
+        this->levels.push_back(std::move(dst));
+    }
+}
+
+Color Texture::Fetch(uint32_t level, int32_t x, int32_t y) const
+{
+    const MipLevel& mip = this->levels[level];
+    return mip.texels[TexelIndex(mip, Wrap(x, mip.width), Wrap(y, mip.height))];
+}
+
+glm::vec4 Texture::SampleBilinear(glm::vec2 uv, uint32_t level) const
+{
+    if (this->levels.empty())
+        return glm::vec4(1.f);
+    level = std::min(level, this->GetLevelCount() - 1);
+
+    const MipLevel& mip = this->levels[level];
+    float fx = uv.x * static_cast<float>(mip.width) - 0.5f;
+    float fy = uv.y * static_cast<float>(mip.height) - 0.5f;
+
+    // uv of a vertex near w = 0, or from a broken file, may be infinite or NaN: fall back to the coarsest level,
+    //   the average color of the texture. Finite texel coordinates are wrapped into the level (fmod is exact)
+    //   before the conversion, so that any magnitude fits
+    if (!std::isfinite(fx) || !std::isfinite(fy))
+        return ToVec4(this->levels.back().texels[0]);
+    float flx = std::floor(fx), fly = std::floor(fy);
+    float tx = fx - flx, ty = fy - fly;
+    int32_t x0 = static_cast<int32_t>(std::fmod(flx, static_cast<float>(mip.width)));
+    int32_t y0 = static_cast<int32_t>(std::fmod(fly, static_cast<float>(mip.height)));
+
+    glm::vec4 c00 = ToVec4(this->Fetch(level, x0, y0));
+    glm::vec4 c10 = ToVec4(this->Fetch(level, x0 + 1, y0));
+    glm::vec4 c01 = ToVec4(this->Fetch(level, x0, y0 + 1));
+    glm::vec4 c11 = ToVec4(this->Fetch(level, x0 + 1, y0 + 1));
+    return glm::mix(glm::mix(c00, c10, tx), glm::mix(c01, c11, tx), ty);
+}
+
+glm::vec4 Texture::SampleTrilinear(glm::vec2 uv, float lod) const
+{
+    if (this->levels.empty())
+        return glm::vec4(1.f);
+
+    float maxLod = static_cast<float>(this->GetLevelCount() - 1);
+    lod = lod > 0.f ? std::min(lod, maxLod) : 0.f;     // NaN selects the finest level
+    uint32_t l0 = static_cast<uint32_t>(lod);
+    float t = lod - static_cast<float>(l0);
+    if (t == 0.f)
+        return this->SampleBilinear(uv, l0);
+    return glm::mix(this->SampleBilinear(uv, l0), this->SampleBilinear(uv, l0 + 1), t);
+}
+
+glm::vec4 Texture::Sample(glm::vec2 uv, glm::vec2 dUVdx, glm::vec2 dUVdy) const
+{
+    if (this->levels.empty())
+        return glm::vec4(1.f);
+
+    glm::vec2 size(this->levels[0].width, this->levels[0].height);
+    float rho = std::max(glm::length(dUVdx * size), glm::length(dUVdy * size));
+    float lod = rho > 1.f ? std::log2(rho) : 0.f;
+    return this->SampleTrilinear(uv, lod);
+}
@@ -0,0 +1,73 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image.hpp"
+
+#include "../thirdparty/glm/glm.hpp"
+
+// Loads textures through stb_image and samples them with bilinear/trilinear filtering
+
+class Texture
+{
+public:
+    Texture() = default;
+    Texture(std::string filename);
+
+    // Load the image at `filename` as RGBA8 and build the complete mip chain.
+    //     Returns false (leaving the texture empty) if the file cannot be decoded
+    bool Load();
+
+    // Build the texture from a row-major RGBA8 buffer whose first row is the top of the image
+    void FromPixels(uint32_t width, uint32_t height, const Color* pixels);
+
+    /**
+     * Sample a single mip level with bilinear filtering. Coordinates wrap around (repeat mode);
+     *   (0, 0) is the bottom-left of the image, following the OBJ `vt` convention.
+     *   Infinite or NaN coordinates give the average color of the texture.
+     * @return: the filtered color with all channels in [0, 1]
+     */
+    glm::vec4 SampleBilinear(glm::vec2 uv, uint32_t level = 0) const;
+
+    // Blend bilinear samples of the two mip levels around the fractional `lod`
+    glm::vec4 SampleTrilinear(glm::vec2 uv, float lod) const;
+
+    // Select the lod from the screen-space derivatives of uv and sample trilinearly
+    glm::vec4 Sample(glm::vec2 uv, glm::vec2 dUVdx, glm::vec2 dUVdy) const;
+
+    inline bool Empty() const { return this->levels.empty(); }
+    inline uint32_t GetLevelCount() const { return static_cast<uint32_t>(this->levels.size()); }
+    inline uint32_t GetWidth(uint32_t level = 0) const { return this->levels[level].width; }
+    inline uint32_t GetHeight(uint32_t level = 0) const { return this->levels[level].height; }
+    inline const std::string& GetFilename() const { return this->filename; }
+
+    // Unfiltered texel read with repeat addressing; x/y are in texels of the given level
+    Color Fetch(uint32_t level, int32_t x, int32_t y) const;
+
+private:
+    // Texels are stored in 8x8 tiles, laid out row-major over the tiles; inside a tile
+    //   the 64 texels follow Morton (Z-order), so a bilinear footprint and neighbouring
+    //   pixels of a triangle touch one or two 256 byte tiles instead of two full rows.
+    struct MipLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t tilesX;
+        std::vector<Color> texels;
+    };
+
+    static constexpr uint32_t TILE_BITS = 3;
+    static constexpr uint32_t TILE_SIZE = 1u << TILE_BITS;
+
+    static size_t TexelIndex(const MipLevel& level, uint32_t x, uint32_t y);
+    static MipLevel MakeLevel(uint32_t width, uint32_t height);
+    void GenerateMips();
+
+    std::string filename;
+    std::vector<MipLevel> levels;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef OBJPARALLEL_H
+#define OBJPARALLEL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../thirdparty/tinyobj/tiny_obj_loader.h"
+
+// Multi-threaded Wavefront .obj reader with the same interface and output layout as tinyobj::ObjReader.
+//   The file is split into line-aligned chunks that are parsed and triangulated concurrently; the
+//   chunks are then merged by offsetting their indices and stitching shapes that span chunk borders.
+//   Polygons are triangulated as fans (exact for the convex faces exported by DCC tools), and
+//   smoothing groups are not recorded. Materials are loaded with tinyobj::LoadMtl.
+//
+// Fork of HW1/rasterizer/objparallel.hpp/.cpp, kept here since every homework builds on its own against
+//   its own copy of tinyobj. The two are identical apart from this note; change both
+
+class ParallelObjReader
+{
+public:
+    ParallelObjReader() = default;
+
+    // `threads` is the number of chunks parsed concurrently; 0 uses every hardware thread
+    bool ParseFromFile(const std::string& filename, const tinyobj::ObjReaderConfig& config = tinyobj::ObjReaderConfig(),
+        uint32_t threads = 0);
+
+    inline bool Valid() const { return this->valid; }
+    inline const tinyobj::attrib_t& GetAttrib() const { return this->attrib; }
+    inline const std::vector<tinyobj::shape_t>& GetShapes() const { return this->shapes; }
+    inline const std::vector<tinyobj::material_t>& GetMaterials() const { return this->materials; }
+    // The .mtl files named by `mtllib`, relative to the search path, whether they were found or not
+    inline const std::vector<std::string>& GetMaterialLibraries() const { return this->materialLibraries; }
+    inline const std::string& Warning() const { return this->warning; }
+    inline const std::string& Error() const { return this->error; }
+
+private:
+    bool valid = false;
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::vector<std::string> materialLibraries;
+    std::string warning;
+    std::string error;
+};
+
+#endif
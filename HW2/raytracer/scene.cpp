@@ -8,7 +8,7 @@
 #include "../thirdparty/tinyobj/tiny_obj_loader.h"
 
 
-tinyobj::ObjReader Scene::reader {};
+ParallelObjReader Scene::reader {};
 
 void Scene::addObjects(std::string_view modelPath, std::string_view searchPath) {
     tinyobj::ObjReaderConfig config;
@@ -2,13 +2,14 @@
 
 #include "../thirdparty/tinyobj/tiny_obj_loader.h"
 #include "accel.hpp"
+#include "objparallel.hpp"
 
 #include <string>
 #include <vector>
 
 class Scene {
 public:
-    static tinyobj::ObjReader reader;
+    static ParallelObjReader reader;
     std::vector<Object*> objects;
     std::vector<Object*> lights;
     BVH bvh;